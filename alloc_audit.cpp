@@ -0,0 +1,189 @@
+#include "alloc_audit.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+// threads past the first ALLOC_THREADS - 1 share the last slot
+#define ALLOC_THREADS 64
+
+// One thread's counts. Other threads sum them up while it counts, hence
+// the atomics; static and zero initialised, so counting never allocates.
+struct ThreadCounts {
+  std::atomic<uint64_t> allocs[PHASE_COUNT];
+  std::atomic<uint64_t> bytes[PHASE_COUNT];
+  std::atomic<uint64_t> frees[PHASE_COUNT];
+};
+
+static ThreadCounts counts[ALLOC_THREADS];
+static std::atomic<uint32_t> threads_seen{0};
+static thread_local ThreadCounts *tls_counts = nullptr;
+
+static ThreadCounts *own_counts() {
+  if (!tls_counts) {
+    uint32_t slot = threads_seen.fetch_add(1, std::memory_order_relaxed);
+    tls_counts = &counts[std::min<uint32_t>(slot, ALLOC_THREADS - 1)];
+  }
+  return tls_counts;
+}
+
+static void counted(LoopPhase phase, size_t size) {
+  ThreadCounts *c = own_counts();
+  c->allocs[phase].fetch_add(1, std::memory_order_relaxed);
+  c->bytes[phase].fetch_add(size, std::memory_order_relaxed);
+}
+
+static void *counted_alloc(size_t size) {
+  counted(current_phase(), size);
+  void *p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+static void *counted_alloc(size_t size, std::align_val_t align) {
+  counted(current_phase(), size);
+  void *p = nullptr;
+  size_t a = std::max(static_cast<size_t>(align), sizeof(void *));
+  if (posix_memalign(&p, a, size ? size : 1)) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+static void counted_free(void *p) {
+  if (p) {
+    own_counts()->frees[current_phase()].fetch_add(
+        1, std::memory_order_relaxed);
+    free(p);
+  }
+}
+
+void *operator new(size_t size) { return counted_alloc(size); }
+void *operator new[](size_t size) { return counted_alloc(size); }
+void operator delete(void *p) noexcept { counted_free(p); }
+void operator delete[](void *p) noexcept { counted_free(p); }
+void operator delete(void *p, size_t) noexcept { counted_free(p); }
+void operator delete[](void *p, size_t) noexcept { counted_free(p); }
+
+// the over-aligned forms go straight to aligned_alloc in libstdc++, and
+// older ones do the same with malloc for nothrow, so all of them are
+// counted here
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  try {
+    return counted_alloc(size);
+  } catch (...) {
+    return nullptr;
+  }
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  try {
+    return counted_alloc(size);
+  } catch (...) {
+    return nullptr;
+  }
+}
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  counted_free(p);
+}
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  counted_free(p);
+}
+void *operator new(size_t size, std::align_val_t align) {
+  return counted_alloc(size, align);
+}
+void *operator new[](size_t size, std::align_val_t align) {
+  return counted_alloc(size, align);
+}
+void *operator new(size_t size, std::align_val_t align,
+                   const std::nothrow_t &) noexcept {
+  try {
+    return counted_alloc(size, align);
+  } catch (...) {
+    return nullptr;
+  }
+}
+void *operator new[](size_t size, std::align_val_t align,
+                     const std::nothrow_t &) noexcept {
+  try {
+    return counted_alloc(size, align);
+  } catch (...) {
+    return nullptr;
+  }
+}
+void operator delete(void *p, std::align_val_t) noexcept { counted_free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept {
+  counted_free(p);
+}
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+  counted_free(p);
+}
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+  counted_free(p);
+}
+void operator delete(void *p, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  counted_free(p);
+}
+void operator delete[](void *p, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  counted_free(p);
+}
+
+static void add_counts(const ThreadCounts &c, AllocStats *out) {
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    out->allocs[i] += c.allocs[i].load(std::memory_order_relaxed);
+    out->bytes[i] += c.bytes[i].load(std::memory_order_relaxed);
+    out->frees[i] += c.frees[i].load(std::memory_order_relaxed);
+  }
+}
+
+void alloc_stats(AllocStats *out) {
+  *out = AllocStats();
+  add_counts(*own_counts(), out);
+}
+
+void alloc_stats_all(AllocStats *out) {
+  *out = AllocStats();
+  uint32_t n = std::min<uint32_t>(
+      threads_seen.load(std::memory_order_relaxed), ALLOC_THREADS);
+  for (uint32_t t = 0; t < n; t++) {
+    add_counts(counts[t], out);
+  }
+}
+
+uint64_t alloc_total() {
+  uint64_t total = 0;
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    total += own_counts()->allocs[i].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+void alloc_diff(const AllocStats &before, const AllocStats &after,
+                AllocStats *out) {
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    out->allocs[i] = after.allocs[i] - before.allocs[i];
+    out->bytes[i] = after.bytes[i] - before.bytes[i];
+    out->frees[i] = after.frees[i] - before.frees[i];
+  }
+}
+
+bool alloc_report(const char *what, const AllocStats &stats) {
+  bool any = false;
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    if (stats.allocs[i] == 0 && stats.frees[i] == 0) {
+      continue;
+    }
+    // printf, a stream could allocate while we report
+    printf("%s %-8s allocs:%lu bytes:%lu frees:%lu\n", what,
+           phase_name(static_cast<LoopPhase>(i)),
+           static_cast<unsigned long>(stats.allocs[i]),
+           static_cast<unsigned long>(stats.bytes[i]),
+           static_cast<unsigned long>(stats.frees[i]));
+    any = any || stats.allocs[i] > 0;
+  }
+  return any;
+}
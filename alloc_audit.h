@@ -0,0 +1,24 @@
+#pragma once
+#include "phase.h"
+#include <stdint.h>
+
+// Heap use per thread and loop phase, counted by the global operator new
+// and delete in alloc_audit.cpp. Linking that file is all it takes.
+struct AllocStats {
+  uint64_t allocs[PHASE_COUNT];
+  uint64_t bytes[PHASE_COUNT];
+  uint64_t frees[PHASE_COUNT];
+};
+
+// Counts of the calling thread since it started.
+void alloc_stats(AllocStats *out);
+// Counts of every thread of the process, exited ones included.
+void alloc_stats_all(AllocStats *out);
+// Allocations of the calling thread in all phases.
+uint64_t alloc_total();
+// after - before, per phase
+void alloc_diff(const AllocStats &before, const AllocStats &after,
+                AllocStats *out);
+// Prints the phases that allocated or freed, returns true if any phase
+// allocated.
+bool alloc_report(const char *what, const AllocStats &stats);
@@ -0,0 +1,19 @@
+#include "arena.h"
+#include <new>
+
+void *ArenaResource::do_allocate(size_t bytes, size_t align) {
+  uintptr_t at = reinterpret_cast<uintptr_t>(base_) + used_;
+  at = (at + align - 1) & ~static_cast<uintptr_t>(align - 1);
+  size_t end = at - reinterpret_cast<uintptr_t>(base_) + bytes;
+  if (end > size_) {
+    throw std::bad_alloc();
+  }
+  used_ = end;
+  return reinterpret_cast<void *>(at);
+}
+
+ArenaResource *control_arena() {
+  alignas(64) static char buffer[CONTROL_ARENA_BYTES];
+  static ArenaResource arena(buffer, sizeof(buffer));
+  return &arena;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <memory_resource>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+#define CONTROL_ARENA_BYTES (64 * 1024)
+
+// Bump allocator over one caller-owned block. Nothing is given back before
+// the arena goes away, and running out throws instead of falling back to
+// the heap. Not thread safe, it belongs to the control loop.
+class ArenaResource : public std::pmr::memory_resource {
+public:
+  ArenaResource(void *buffer, size_t size)
+      : base_(static_cast<char *>(buffer)), size_(size) {}
+  ~ArenaResource() {}
+  size_t used() const { return used_; }
+  size_t capacity() const { return size_; }
+
+private:
+  void *do_allocate(size_t bytes, size_t align) override;
+  void do_deallocate(void *p, size_t bytes, size_t align) override {}
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override {
+    return this == &other;
+  }
+
+private:
+  char *base_;
+  size_t size_;
+  size_t used_{0};
+};
+
+// The process wide arena the control state of toy_car lives in.
+ArenaResource *control_arena();
+
+// Constructs a T in the arena. Pair with arena_delete, which only runs the
+// destructor, the memory comes back with the arena.
+template <typename T, typename... Args>
+T *arena_new(std::pmr::memory_resource *mr, Args &&... args) {
+  void *p = mr->allocate(sizeof(T), alignof(T));
+  return new (p) T(std::forward<Args>(args)...);
+}
+
+template <typename T> void arena_delete(T *p) {
+  if (p) {
+    p->~T();
+  }
+}
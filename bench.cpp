@@ -0,0 +1,176 @@
+// Microbenchmarks of the control path: command decode, dispatch, motor
+// calls, sonar math and path planning. Links null_lgpio.cpp, so the numbers are the cost
+// of our own code with the GPIO calls taken out.
+#include "alloc_audit.h"
+#include "car.h"
+#include "commander.h"
+#include "grid.h"
+#include "mixer.h"
+#include "planner.h"
+#include "sonar.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static volatile uint64_t sink;
+
+// Runs fn(i) for long enough to get a stable time and prints ns and heap
+// allocations per call.
+template <typename F> static void bench(const char *name, F fn) {
+  typedef std::chrono::steady_clock clock;
+  for (uint64_t i = 0; i < 1000; i++) {
+    fn(i);
+  }
+  uint64_t iters = 1000;
+  while (true) {
+    uint64_t allocs = alloc_total();
+    auto t0 = clock::now();
+    for (uint64_t i = 0; i < iters; i++) {
+      fn(i);
+    }
+    double ns = std::chrono::duration<double, std::nano>(clock::now() - t0)
+                    .count();
+    allocs = alloc_total() - allocs;
+    if (ns > 2e8 || iters >= (1ULL << 32)) {
+      printf("%-28s %10.1f ns/op %8.2f allocs/op %12lu ops\n", name,
+             ns / iters, static_cast<double>(allocs) / iters,
+             static_cast<unsigned long>(iters));
+      return;
+    }
+    iters *= ns < 2e7 ? 10 : 2;
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *filter = argc > 1 ? argv[1] : nullptr;
+  if (filter && !strcmp(filter, "--help")) {
+    printf("usage: %s [name prefix]\n", argv[0]);
+    return 1;
+  }
+  auto wanted = [filter](const char *name) {
+    return !filter || !strncmp(name, filter, strlen(filter));
+  };
+
+  Car car;
+  if (car.init()) {
+    printf("failed to init car\n");
+    return 1;
+  }
+  // the control code logs every call, that is the terminal's cost, not ours
+  std::cout.setstate(std::ios_base::badbit);
+
+  static const int axis[] = {0, -32767, 32767};
+  if (wanted("decode.joystick")) {
+    bench("decode.joystick", [](uint64_t i) {
+      std::string cmd = joystick_cmd(axis[i % 3], axis[i / 3 % 3], i % 17 == 0);
+      sink += cmd.size();
+    });
+  }
+  if (wanted("decode.infrared")) {
+    bench("decode.infrared", [](uint64_t i) {
+      std::string cmd = infrared_cmd(i & 1, i >> 1 & 1, i >> 2 & 1, i >> 3 & 1);
+      sink += cmd.size();
+    });
+  }
+
+  if (wanted("decode.mixer")) {
+    static DriveMixer mixer;
+    bench("decode.mixer", [](uint64_t i) {
+      int32_t left, right;
+      mixer.mix(static_cast<int>(i * 7919 % 65535) - 32767,
+                static_cast<int>(i * 104729 % 65535) - 32767, &left, &right);
+      sink += left + right;
+    });
+  }
+
+  static const std::string words[] = {"forward", "left",  "right",
+                                      "backward", "brake", "f"};
+  if (wanted("dispatch.execute")) {
+    bench("dispatch.execute",
+          [&car](uint64_t i) { car.execute(words[i % 6]); });
+  }
+  if (wanted("car.move_forward")) {
+    bench("car.move_forward", [&car](uint64_t) { car.move_forward(); });
+  }
+  if (wanted("car.move_backward")) {
+    bench("car.move_backward", [&car](uint64_t) { car.move_backward(); });
+  }
+  if (wanted("car.turn_left")) {
+    bench("car.turn_left", [&car](uint64_t) { car.turn_left(); });
+  }
+  if (wanted("car.turn_right")) {
+    bench("car.turn_right", [&car](uint64_t) { car.turn_right(); });
+  }
+  if (wanted("car.drive")) {
+    bench("car.drive", [&car](uint64_t i) {
+      car.drive(static_cast<int32_t>(i % 201) - 100, 60);
+    });
+  }
+  if (wanted("car.set_velocity")) {
+    bench("car.set_velocity", [&car](uint64_t i) {
+      car.set_velocity(0.2 + (i % 8) * 0.1, (i % 5) * 0.1 - 0.2);
+    });
+  }
+  if (wanted("car.set_velocity.same")) {
+    bench("car.set_velocity.same",
+          [&car](uint64_t) { car.set_velocity(0.5, 0.1); });
+  }
+  if (wanted("car.brake")) {
+    bench("car.brake", [&car](uint64_t) { car.brake(); });
+  }
+
+  if (wanted("sonar.echo_to_distance")) {
+    bench("sonar.echo_to_distance", [](uint64_t i) {
+      sink += static_cast<uint64_t>(
+          Sonar::echo_to_distance(150 + i % 23000) * 1000);
+    });
+  }
+
+  if (wanted("grid.integrate")) {
+    // one sonar reading at the sonar's full 4m, 80 cells along the ray
+    static OccupancyGrid grid;
+    grid.open("", 10, 10, 0.05);
+    bench("grid.integrate", [](uint64_t i) {
+      Pose at = {0, 0, 0};
+      grid.integrate(at, (i % 360) * M_PI / 180, 3.9);
+      grid.clear_changes();
+    });
+  }
+
+  if (wanted("planner.")) {
+    // the sim room's map, with a wall 1.5m ahead of the car seen by a
+    // sonar sweep
+    static OccupancyGrid grid;
+    grid.open("", 10, 10, 0.05);
+    Pose at = {0, 0, 0};
+    for (int pass = 0; pass < 3; pass++) {
+      for (int deg = -50; deg <= 50; deg++) {
+        double a = deg * M_PI / 180;
+        grid.integrate(at, a, 1.5 / std::cos(a));
+      }
+    }
+    static GridPlanner planner(grid, 0.2);
+    planner.init();
+    planner.update_from_grid(grid);
+    if (wanted("planner.plan")) {
+      // a fresh search, what a new goal costs
+      bench("planner.plan", [](uint64_t i) {
+        planner.set_goal(3, i & 1 ? 1 : -1);
+        sink += planner.replan();
+      });
+    }
+    if (wanted("planner.replan")) {
+      // the car moves a cell between ticks, the search is repaired
+      planner.set_goal(3, 0);
+      bench("planner.replan", [](uint64_t i) {
+        uint64_t step = i % 40;
+        planner.set_start(-1 + 0.05 * (step < 20 ? step : 40 - step), 0);
+        sink += planner.replan();
+      });
+    }
+  }
+  std::cout.clear();
+  return 0;
+}
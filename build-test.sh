@@ -1 +1,44 @@
-g++ main.cpp car.cpp joystick.cpp commander.cpp sonar.cpp -llgpio -std=c++0x -Wall -o toy_car
+SRCS="phase.cpp alloc_audit.cpp arena.cpp histogram.cpp perf_counters.cpp trace.cpp car.cpp joystick.cpp gamepad.cpp mixer.cpp deadline.cpp car_state.cpp cmd_ring.cpp telemetry.cpp commander.cpp dispatch.cpp sonar.cpp escape.cpp speed.cpp scanner.cpp pose.cpp grid.cpp planner.cpp"
+# every lgpio call goes through gpio_probe.cpp, TOY_CAR_GPIO_PROBE=1 times them
+GPIO_PROBE="gpio_probe.cpp -Wl,--wrap=lgGpiochipOpen,--wrap=lgGpiochipClose,--wrap=lgGpioClaimInput,--wrap=lgGpioClaimOutput,--wrap=lgGpioFree,--wrap=lgGpioRead,--wrap=lgGpioWrite,--wrap=lgTxPwm,--wrap=lgTxServo,--wrap=lgGroupClaimInput,--wrap=lgGroupClaimOutput,--wrap=lgGroupFree,--wrap=lgGroupRead,--wrap=lgGroupWrite,--wrap=lgGpioClaimAlert,--wrap=lgGpioSetAlertsFunc"
+g++ main.cpp $SRCS $GPIO_PROBE -llgpio -std=c++17 -Wall -pthread -o toy_car
+# Pi 5 only: GPIO straight through the RP1 registers, no lgpio needed
+g++ main.cpp rp1_gpio.cpp rp1_lgpio.cpp $SRCS $GPIO_PROBE -std=c++17 -Wall -pthread -O2 -o toy_car_rp1
+# fails if the RP1 backend stores the wrong register words, checked on a
+# 192 KiB file standing in for the register block
+g++ rp1_check.cpp rp1_gpio.cpp -std=c++17 -Wall -pthread -O2 -o toy_car_rp1_check
+./toy_car_rp1_check
+# spins the car in place to measure its turn rate, see TOY_CAR_TURN_RATE
+g++ spin.cpp $SRCS $GPIO_PROBE -llgpio -std=c++17 -Wall -pthread -O2 -o toy_car_spin
+# live view of a running car, from its shared memory page
+g++ top.cpp car_state.cpp -std=c++17 -Wall -O2 -o toy_car_top
+# telemetry frames to CSV
+g++ telemetry_csv.cpp telemetry.cpp -std=c++17 -Wall -O2 -o toy_car_telemetry
+# runs a commander in its own process, feeding the car through shared memory
+g++ host.cpp $SRCS $GPIO_PROBE -llgpio -std=c++17 -Wall -pthread -O2 -o toy_car_host
+# drives a running car over its control socket
+g++ ctl.cpp histogram.cpp -std=c++17 -Wall -O2 -o toy_car_ctl
+# simulated car, links the lgpio stand-in instead of the library
+g++ sim_main.cpp sim.cpp sim_lgpio.cpp $SRCS -std=c++17 -Wall -pthread -O2 -o toy_car_sim
+./toy_car_sim --hours 1
+# fails if analog drive or set_velocity turns the other way than the words
+./toy_car_sim --steering-check
+# fails if the cruise control is not three times as fast as the old fixed
+# duty on the same courses, or hits more per km
+./toy_car_sim --cruise-check --hours 4
+# fails if the path planner does not get the car around a wall
+./toy_car_sim --planner-check
+# fails if one sweep of the panning sonar misses angles or pings twice
+./toy_car_sim --scanner-check
+# fails if the control loop still allocates once it is running
+./toy_car_sim --hours 0.2 --alloc-check
+# autopilot parameter sweep over simulated courses
+g++ tuner.cpp pool.cpp sim.cpp sim_lgpio.cpp $SRCS -std=c++17 -Wall -pthread -O2 -o toy_car_tuner
+# control path microbenchmarks against a GPIO backend that does nothing
+g++ bench.cpp null_lgpio.cpp $SRCS -std=c++17 -Wall -pthread -O2 -o toy_car_bench
+./toy_car_bench
+# GPIO throughput of each backend, one JSON object per result
+g++ gpio_bench.cpp histogram.cpp -llgpio -std=c++17 -Wall -pthread -O2 -o toy_car_gpio_bench
+g++ gpio_bench.cpp rp1_gpio.cpp rp1_lgpio.cpp histogram.cpp -std=c++17 -Wall -pthread -O2 -o toy_car_gpio_bench_rp1
+g++ gpio_bench.cpp gpio_bench_sim.cpp sim.cpp sim_lgpio.cpp $SRCS -std=c++17 -Wall -pthread -O2 -o toy_car_gpio_bench_sim
+./toy_car_gpio_bench_sim
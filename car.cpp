@@ -1,4 +1,8 @@
 #include "car.h"
+#include "phase.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
 
 int Motor::init() {
   // AT8236驱动方式：IN1=1 IN2=1 --> 刹车
@@ -12,37 +16,88 @@ int Motor::init() {
 }
 
 void Motor::move_forward(uint32_t speed) {
-  std::cout << "motor:" << name_ << " move forward,"
-            << " ctl:" << ctl_ << " p1:" << p1_ << " p2:" << p2_
-            << " speed:" << speed << std::endl;
   // AT8236驱动方式：IN1=1 IN2=0 --> 正转
   // lgGpioWrite(ctl_, p1_, 1);
   // lgGpioWrite(ctl_, p2_, 0);
   lgTxPwm(ctl_, p1_, MOTOR_DRIVE_PWM_FREQ_HZ, revise_speed(speed), 0, 0);
   lgTxPwm(ctl_, p2_, 0, 0, 0, 0);
   lgGpioWrite(ctl_, p2_, 0);
+  duty_ = revise_speed(speed);
+  known_ = true;
+  action_ = FORWARD;
 }
 
 void Motor::move_backward(uint32_t speed) {
-  std::cout << "motor:" << name_ << " move backward,"
-            << " ctl:" << ctl_ << " p1:" << p1_ << " p2:" << p2_
-            << " speed:" << speed << std::endl;
   // AT8236驱动方式：IN1=0 IN2=1 --> 反转
   // lgGpioWrite(ctl_, p1_, 0);
   // lgGpioWrite(ctl_, p2_, 1);
   lgTxPwm(ctl_, p1_, 0, 0, 0, 0);
   lgGpioWrite(ctl_, p1_, 0);
   lgTxPwm(ctl_, p2_, MOTOR_DRIVE_PWM_FREQ_HZ, revise_speed(speed), 0, 0);
+  duty_ = -static_cast<int32_t>(revise_speed(speed));
+  known_ = true;
+  action_ = BACKWARD;
 }
 
 void Motor::brake() {
-  std::cout << "motor:" << name_ << " brake,"
-            << " ctl:" << ctl_ << " p1:" << p1_ << " p2:" << p2_ << std::endl;
   // AT8236驱动方式：IN1=1 IN2=1 --> 刹车
   lgTxPwm(ctl_, p1_, 0, 0, 0, 0);
   lgTxPwm(ctl_, p2_, 0, 0, 0, 0);
   lgGpioWrite(ctl_, p1_, 0);
   lgGpioWrite(ctl_, p2_, 0);
+  duty_ = 0;
+  known_ = true;
+  action_ = BRAKE;
+}
+
+void Motor::drive(int32_t duty) {
+  if (duty != 0) {
+    uint32_t speed = revise_speed(std::abs(duty));
+    duty = duty > 0 ? speed : -static_cast<int32_t>(speed);
+  }
+  if (known_ && duty == duty_) {
+    return;
+  }
+  if (known_ && duty != 0 && duty_ != 0 && (duty > 0) == (duty_ > 0)) {
+    // same direction, only the PWM pin changes
+    lgTxPwm(ctl_, duty > 0 ? p1_ : p2_, MOTOR_DRIVE_PWM_FREQ_HZ,
+            std::abs(duty), 0, 0);
+    from_ = duty_;
+    duty_ = duty;
+    action_ = DUTY;
+    return;
+  }
+  if (duty > 0) {
+    move_forward(duty);
+  } else if (duty < 0) {
+    move_backward(-duty);
+  } else {
+    brake();
+  }
+}
+
+void Motor::report() const {
+  if (action_ == NONE) {
+    return;
+  }
+  PhaseScope log(PHASE_LOG);
+  std::cout << "motor:" << name_;
+  if (action_ == DUTY) {
+    std::cout << " duty " << from_ << " -> " << duty_ << std::endl;
+    return;
+  }
+  if (action_ == FORWARD) {
+    std::cout << " move forward,";
+  } else if (action_ == BACKWARD) {
+    std::cout << " move backward,";
+  } else {
+    std::cout << " brake,";
+  }
+  std::cout << " ctl:" << ctl_ << " p1:" << p1_ << " p2:" << p2_;
+  if (action_ != BRAKE) {
+    std::cout << " speed:" << std::abs(duty_);
+  }
+  std::cout << std::endl;
 }
 
 uint32_t Motor::revise_speed(uint32_t speed) {
@@ -66,8 +121,8 @@ int Car::init() {
   if (rc) {
     return rc;
   }
-  motors_["left_rear"] = left;
-  motors_["right_rear"] = right;
+  motors_[LEFT_REAR] = left;
+  motors_[RIGHT_REAR] = right;
 
   // add two mor motors here
   uint32_t left_front_p1 = 5;
@@ -84,55 +139,150 @@ int Car::init() {
   if (rc) {
     return rc;
   }
-  motors_["left_front"] = left1;
-  motors_["right_front"] = right1;
+  motors_[LEFT_FRONT] = left1;
+  motors_[RIGHT_FRONT] = right1;
 
   return 0;
 }
 
-void Car::move_forward() {
-  motors_["left_rear"].move_forward(forward_speed_);
-  motors_["right_rear"].move_forward(forward_speed_);
-  motors_["left_front"].move_forward(forward_speed_);
-  motors_["right_front"].move_forward(forward_speed_);
+template <typename F> void Car::locked(F motion) {
+  Motor seen[MOTOR_COUNT];
+  const char *banner;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int i = 0; i < MOTOR_COUNT; i++) {
+      motors_[i].forget();
+    }
+    banner = motion();
+    std::copy(motors_, motors_ + MOTOR_COUNT, seen);
+  }
+  // stdout can block for a long time (ssh, a log on the SD card), the
+  // pins are already set and the emergency stop never waits for it
+  PhaseScope log(PHASE_LOG);
+  if (banner) {
+    std::cout << banner << std::endl;
+  }
+  for (int i = 0; i < MOTOR_COUNT; i++) {
+    seen[i].report();
+  }
 }
 
-void Car::move_backward() {
-  motors_["left_rear"].move_backward(backward_speed_);
-  motors_["right_rear"].move_backward(backward_speed_);
-  motors_["left_front"].move_backward(backward_speed_);
-  motors_["right_front"].move_backward(backward_speed_);
+void Car::forward_pins() {
+  TRACE_SPAN("Car::move_forward");
+  motors_[LEFT_REAR].move_forward(forward_speed_);
+  motors_[RIGHT_REAR].move_forward(forward_speed_);
+  motors_[LEFT_FRONT].move_forward(forward_speed_);
+  motors_[RIGHT_FRONT].move_forward(forward_speed_);
 }
 
-void Car::turn_left(bool spin) {
-  motors_["left_rear"].move_forward(turn_speed_);
-  motors_["left_front"].move_forward(turn_speed_);
+void Car::backward_pins() {
+  TRACE_SPAN("Car::move_backward");
+  motors_[LEFT_REAR].move_backward(backward_speed_);
+  motors_[RIGHT_REAR].move_backward(backward_speed_);
+  motors_[LEFT_FRONT].move_backward(backward_speed_);
+  motors_[RIGHT_FRONT].move_backward(backward_speed_);
+}
+
+void Car::left_pins(bool spin) {
+  TRACE_SPAN("Car::turn_left");
+  motors_[LEFT_REAR].move_forward(turn_speed_);
+  motors_[LEFT_FRONT].move_forward(turn_speed_);
   if (spin) {
-    motors_["right_rear"].move_backward(turn_speed_);
-    motors_["right_front"].move_backward(turn_speed_);
+    motors_[RIGHT_REAR].move_backward(turn_speed_);
+    motors_[RIGHT_FRONT].move_backward(turn_speed_);
   } else {
-    motors_["right_rear"].brake();
-    motors_["right_front"].brake();
+    motors_[RIGHT_REAR].brake();
+    motors_[RIGHT_FRONT].brake();
   }
 }
 
-void Car::turn_right(bool spin) {
-  motors_["right_rear"].move_forward(turn_speed_);
-  motors_["right_front"].move_forward(turn_speed_);
+void Car::right_pins(bool spin) {
+  TRACE_SPAN("Car::turn_right");
+  motors_[RIGHT_REAR].move_forward(turn_speed_);
+  motors_[RIGHT_FRONT].move_forward(turn_speed_);
   if (spin) {
-    motors_["left_rear"].move_backward(turn_speed_);
-    motors_["left_front"].move_backward(turn_speed_);
+    motors_[LEFT_REAR].move_backward(turn_speed_);
+    motors_[LEFT_FRONT].move_backward(turn_speed_);
   } else {
-    motors_["left_rear"].brake();
-    motors_["left_front"].brake();
+    motors_[LEFT_REAR].brake();
+    motors_[LEFT_FRONT].brake();
   }
 }
 
+void Car::brake_pins() {
+  TRACE_SPAN("Car::brake");
+  motors_[LEFT_REAR].brake();
+  motors_[RIGHT_REAR].brake();
+  motors_[LEFT_FRONT].brake();
+  motors_[RIGHT_FRONT].brake();
+}
+
+void Car::move_forward() {
+  locked([this] {
+    forward_pins();
+    return nullptr;
+  });
+}
+
+void Car::move_backward() {
+  locked([this] {
+    backward_pins();
+    return nullptr;
+  });
+}
+
+void Car::turn_left(bool spin) {
+  locked([this, spin] {
+    left_pins(spin);
+    return nullptr;
+  });
+}
+
+void Car::turn_right(bool spin) {
+  locked([this, spin] {
+    right_pins(spin);
+    return nullptr;
+  });
+}
+
 void Car::brake() {
-  motors_["left_rear"].brake();
-  motors_["right_rear"].brake();
-  motors_["left_front"].brake();
-  motors_["right_front"].brake();
+  locked([this] {
+    brake_pins();
+    return nullptr;
+  });
+}
+
+void Car::stop() { brake(); }
+
+bool Car::emergency_stop() {
+  TRACE_SPAN("Car::emergency_stop");
+  std::lock_guard<std::mutex> lock(mutex_);
+  blocked_ = true;
+  int32_t net = 0;
+  for (int i = 0; i < MOTOR_COUNT; i++) {
+    net += motors_[i].duty();
+  }
+  if (net <= 0) {
+    return false;
+  }
+  // the caller says why, nothing is printed here
+  brake_pins();
+  return true;
+}
+
+void Car::fill_state(CarState *state) {
+  static_assert(MOTOR_COUNT == CAR_STATE_MOTORS, "one duty per motor");
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (int i = 0; i < MOTOR_COUNT; i++) {
+    state->duty[i] = motors_[i].duty();
+  }
+  state->blocked = blocked_;
+  state->input_p99_ns = input_latency_.percentile(99);
+}
+
+void Car::emergency_clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  blocked_ = false;
 }
 
 void Car::set_engine(uint32_t f_speed, uint32_t b_speed, uint32_t t_speed) {
@@ -140,3 +290,91 @@ void Car::set_engine(uint32_t f_speed, uint32_t b_speed, uint32_t t_speed) {
   backward_speed_ = b_speed;
   turn_speed_ = t_speed;
 }
+
+void Car::drive(int32_t left, int32_t right) {
+  locked([this, left, right] {
+    drive_sides(left, right);
+    return nullptr;
+  });
+}
+
+void Car::drive_sides(int32_t left, int32_t right) {
+  TRACE_SPAN("Car::drive");
+  if (blocked_ && left + right > 0) {
+    left = right = 0;
+  }
+  // the motors named left sit on the right side of the chassis, see
+  // turn_left
+  motors_[RIGHT_REAR].drive(left);
+  motors_[RIGHT_FRONT].drive(left);
+  motors_[LEFT_REAR].drive(right);
+  motors_[LEFT_FRONT].drive(right);
+}
+
+void Car::set_velocity(double linear, double angular) {
+  TRACE_SPAN("Car::set_velocity");
+  PhaseScope actuate(PHASE_ACTUATE);
+  int32_t left, right;
+  velocity_duties(linear, angular, &left, &right);
+  locked([this, left, right] {
+    drive_sides(left, right);
+    return nullptr;
+  });
+}
+
+void Car::velocity_duties(double linear, double angular, int32_t *left,
+                          int32_t *right) {
+  linear = std::max(-1.0, std::min(1.0, linear));
+  angular = std::max(-1.0, std::min(1.0, angular));
+  double l = linear - angular;
+  double r = linear + angular;
+  // past full speed on one side, scale both down to keep the turn radius
+  double big = std::max(std::fabs(l), std::fabs(r));
+  if (big > 1) {
+    l /= big;
+    r /= big;
+  }
+  *left = static_cast<int32_t>(std::lround(l * 100));
+  *right = static_cast<int32_t>(std::lround(r * 100));
+}
+
+void Car::set_drive(int32_t left, int32_t right) {
+  drive_left_ = left;
+  drive_right_ = right;
+}
+
+void Car::execute(const std::string &cmd, uint64_t source_ns) {
+  TRACE_SPAN("Car::execute");
+  PhaseScope actuate(PHASE_ACTUATE);
+  locked([&]() -> const char * {
+    const char *msg;
+    if (cmd == "left" || cmd == "l") {
+      msg = "............普通左转100ms............";
+      left_pins(true);
+    } else if (cmd == "right" || cmd == "r") {
+      msg = "............普通右转100ms............";
+      right_pins(true);
+    } else if ((cmd == "forward" || cmd == "f") && blocked_) {
+      msg = "............前方有障碍，刹车............";
+      brake_pins();
+    } else if (cmd == "forward" || cmd == "f") {
+      msg = "............前进100ms................";
+      forward_pins();
+    } else if (cmd == "backward" || cmd == "b") {
+      msg = "............后退100ms................";
+      backward_pins();
+    } else if (cmd == "drive") {
+      msg = "............模拟驾驶100ms............";
+      drive_sides(drive_left_, drive_right_);
+    } else {
+      msg = "............刹车...............";
+      brake_pins();
+    }
+    // the motion calls end with the last lgTxPwm
+    if (source_ns) {
+      uint64_t now = lguTimestamp();
+      input_latency_.add(now > source_ns ? now - source_ns : 0);
+    }
+    return msg;
+  });
+}
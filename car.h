@@ -3,16 +3,17 @@ extern "C" {
 #include "lgpio.h"
 }
 #include "commander.h"
+#include "histogram.h"
 #include <iostream>
 #include <unistd.h>
 #include <cassert>
 #include <memory>
-#include <unordered_map>
+#include <mutex>
 
 #define MOTOR_DRIVE_PWM_FREQ_HZ 100 /*Hz*/
 class Motor {
 public:
-  Motor(int controller, const std::string &name, uint32_t p1, uint32_t p2)
+  Motor(int controller, const char *name, uint32_t p1, uint32_t p2)
       : ctl_(controller), name_(name), p1_(p1), p2_(p2) {}
   Motor() : ctl_(-1), name_("unkown"), p1_(UINT32_MAX), p2_(UINT32_MAX) {}
   ~Motor() {}
@@ -20,18 +21,34 @@ public:
   void move_forward(uint32_t speed);
   void move_backward(uint32_t speed);
   void brake();
+  // Signed duty, positive forward, 0 brakes. The pins are only written
+  // when the duty differs from the one they already run.
+  void drive(int32_t duty);
+  int32_t duty() const { return duty_; }
+  // The motion calls only write the pins. This prints what the calls
+  // since the last forget() did, Car calls it on a copy once it has let
+  // go of its lock.
+  void report() const;
+  void forget() { action_ = NONE; }
 
 private:
   uint32_t revise_speed(uint32_t speed);
 
 private:
   int ctl_;
-  std::string name_;
+  const char *name_;
   uint32_t p1_;
   uint32_t p2_;
+  // what the pins run, unknown until the first call
+  int32_t duty_{0};
+  bool known_{false};
+  enum Action { NONE, FORWARD, BACKWARD, BRAKE, DUTY };
+  Action action_{NONE};
+  // duty before a DUTY change
+  int32_t from_{0};
 };
 
-class Car {
+class Car : public EmergencyStop {
 public:
   Car(){};
   ~Car(){};
@@ -42,11 +59,61 @@ public:
   void turn_right(bool spin = true);
   void brake();
   void set_engine(uint32_t f_speed, uint32_t b_speed, uint32_t t_speed);
+  // Skid steering: signed duty -100..100 for each side of the chassis as
+  // seen from behind, 0 brakes it.
+  void drive(int32_t left, int32_t right);
+  // Duties the "drive" command runs with.
+  void set_drive(int32_t left, int32_t right);
+  // linear and angular in -1..1: full speed forward, and a full spin to
+  // the left (counter-clockwise). Mixed into the four wheel duties, only
+  // the motors whose duty changes are written.
+  void set_velocity(double linear, double angular);
+  // The chassis side duties set_velocity drives with, as for drive().
+  static void velocity_duties(double linear, double angular, int32_t *left,
+                              int32_t *right);
+  // Runs one command word, anything unknown brakes. source_ns is the
+  // cmd_stamp() of the input behind it, 0 if there was none.
+  void execute(const std::string &cmd, uint64_t source_ns = 0);
+  // Input event to the last motor's lgTxPwm, in ns.
+  const Histogram &input_latency() const { return input_latency_; }
+  // Brakes, from any thread. Every motion call takes the same lock, and
+  // prints what it did only after letting go of it.
+  void stop();
+  // While stopped for an obstacle, forward commands brake and analog
+  // drive with a forward net brakes. Writes the pins and prints nothing.
+  bool emergency_stop() override;
+  void emergency_clear() override;
+  // Motor duties and the forward block, from any thread.
+  void fill_state(CarState *state);
 
 private:
+  // the motions themselves, called with the lock held
+  void forward_pins();
+  void backward_pins();
+  void left_pins(bool spin);
+  void right_pins(bool spin);
+  void brake_pins();
+  void drive_sides(int32_t left, int32_t right);
+  // Runs motion under the lock, then prints the banner it returns (may be
+  // null) and what the motors did.
+  template <typename F> void locked(F motion);
+
+private:
+  enum MOTOR {
+    LEFT_REAR = 0,
+    RIGHT_REAR = 1,
+    LEFT_FRONT = 2,
+    RIGHT_FRONT = 3,
+    MOTOR_COUNT = 4,
+  };
   int32_t ctl_handle_;
-  std::unordered_map<std::string, Motor> motors_;
+  Motor motors_[MOTOR_COUNT];
   uint32_t forward_speed_{90};
   uint32_t backward_speed_{40};
   uint32_t turn_speed_{40};
+  int32_t drive_left_{0};
+  int32_t drive_right_{0};
+  Histogram input_latency_;
+  bool blocked_{false};
+  std::mutex mutex_;
 };
@@ -0,0 +1,87 @@
+#include "car_state.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void car_state_clear(CarState *state) {
+  memset(state, 0, sizeof(*state));
+  for (int i = 0; i < CAR_STATE_IR; i++) {
+    state->ir[i] = -1;
+  }
+  state->sonar_m = -1;
+}
+
+CarStatePage *car_state_publish_open() {
+  int fd = shm_open(CAR_STATE_SHM, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return nullptr;
+  }
+  if (ftruncate(fd, sizeof(CarStatePage))) {
+    close(fd);
+    return nullptr;
+  }
+  void *p = mmap(nullptr, sizeof(CarStatePage), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    return nullptr;
+  }
+  CarStatePage *page = static_cast<CarStatePage *>(p);
+  // a page left by an earlier run may be mid write, start it over
+  page->seq.store(1, std::memory_order_relaxed);
+  car_state_clear(&page->state);
+  page->version = CAR_STATE_VERSION;
+  page->pid = getpid();
+  page->seq.store(2, std::memory_order_release);
+  return page;
+}
+
+void car_state_publish(CarStatePage *page, const CarState &state) {
+  uint64_t seq = page->seq.load(std::memory_order_relaxed);
+  page->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(&page->state, &state, sizeof(state));
+  page->seq.store(seq + 2, std::memory_order_release);
+}
+
+const CarStatePage *car_state_view_open() {
+  int fd = shm_open(CAR_STATE_SHM, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    return nullptr;
+  }
+  // still empty if the car is just starting up, and reading past the end
+  // of the file would fault
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size < static_cast<off_t>(sizeof(CarStatePage))) {
+    close(fd);
+    return nullptr;
+  }
+  void *p = mmap(nullptr, sizeof(CarStatePage), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    return nullptr;
+  }
+  const CarStatePage *page = static_cast<const CarStatePage *>(p);
+  if (page->version != CAR_STATE_VERSION) {
+    munmap(p, sizeof(CarStatePage));
+    return nullptr;
+  }
+  return page;
+}
+
+bool car_state_read(const CarStatePage *page, CarState *state) {
+  for (int i = 0; i < 1000; i++) {
+    uint64_t before = page->seq.load(std::memory_order_acquire);
+    if (before & 1) {
+      continue;
+    }
+    memcpy(state, &page->state, sizeof(*state));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (page->seq.load(std::memory_order_relaxed) == before) {
+      return true;
+    }
+  }
+  return false;
+}
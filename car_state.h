@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+#define CAR_STATE_SHM "/toy_car_state"
+#define CAR_STATE_VERSION 1
+#define CAR_STATE_MOTORS 4
+#define CAR_STATE_IR 4
+
+// What the car is doing, one snapshot per loop tick. Plain data, readers
+// get a copy. Readings a source does not have stay at -1.
+struct CarState {
+  uint64_t stamp; // lguTimestamp() of the snapshot
+  uint64_t tick;
+  char cmd[16];
+  // joystick, sonar or terminal
+  char source[16];
+  // signed duty per motor: left rear, right rear, left front, right front
+  int32_t duty[CAR_STATE_MOTORS];
+  // forward commands brake, an obstacle is too close
+  int32_t blocked;
+  double sonar_m;
+  int32_t ir[CAR_STATE_IR];
+  // loop stats: wake up to snapshot of the last tick and the worst so far
+  // (a terminal read counts), stale commands refused, stick to wheel p99
+  uint64_t loop_ns;
+  uint64_t loop_max_ns;
+  uint64_t stale;
+  uint64_t input_p99_ns;
+};
+
+// The shared memory page: one writer, the loop, and any number of readers
+// in other processes. seq is odd while a snapshot is being written, a
+// reader that saw it change retries (seqlock). Writing never waits on a
+// reader.
+struct CarStatePage {
+  uint32_t version;
+  uint32_t pid;
+  std::atomic<uint64_t> seq;
+  CarState state;
+};
+
+// Resets state to "nothing known".
+void car_state_clear(CarState *state);
+// Creates or reuses CAR_STATE_SHM and maps it. Returns nullptr on failure.
+CarStatePage *car_state_publish_open();
+void car_state_publish(CarStatePage *page, const CarState &state);
+// Maps CAR_STATE_SHM read only. Returns nullptr if no car has published.
+const CarStatePage *car_state_view_open();
+// Copies a consistent snapshot. Returns false if the writer kept it busy
+// for every try.
+bool car_state_read(const CarStatePage *page, CarState *state);
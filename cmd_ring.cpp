@@ -0,0 +1,112 @@
+#include "cmd_ring.h"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static CmdRing *map_ring(int fd) {
+  void *p = mmap(nullptr, sizeof(CmdRing), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+  close(fd);
+  return p == MAP_FAILED ? nullptr : static_cast<CmdRing *>(p);
+}
+
+CmdRing *cmd_ring_consumer_open() {
+  int fd = shm_open(CMD_RING_SHM, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return nullptr;
+  }
+  if (ftruncate(fd, sizeof(CmdRing))) {
+    close(fd);
+    return nullptr;
+  }
+  CmdRing *ring = map_ring(fd);
+  if (!ring) {
+    return nullptr;
+  }
+  if (ring->version != CMD_RING_VERSION || ring->slots != CMD_RING_SLOTS) {
+    ring->producer.store(0, std::memory_order_relaxed);
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->dropped.store(0, std::memory_order_relaxed);
+    ring->tail.store(0, std::memory_order_relaxed);
+    ring->slots = CMD_RING_SLOTS;
+    std::atomic_thread_fence(std::memory_order_release);
+    ring->version = CMD_RING_VERSION;
+  } else {
+    // a host may still be running from before, its old commands are not
+    // for this run
+    ring->tail.store(ring->head.load(std::memory_order_acquire),
+                     std::memory_order_release);
+  }
+  return ring;
+}
+
+CmdRing *cmd_ring_producer_open() {
+  int fd = shm_open(CMD_RING_SHM, O_RDWR | O_CLOEXEC, 0);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size < static_cast<off_t>(sizeof(CmdRing))) {
+    close(fd);
+    return nullptr;
+  }
+  CmdRing *ring = map_ring(fd);
+  if (!ring) {
+    return nullptr;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (ring->version != CMD_RING_VERSION || ring->slots != CMD_RING_SLOTS) {
+    munmap(ring, sizeof(CmdRing));
+    return nullptr;
+  }
+  // one producer only, a host that died without letting go is replaced
+  int32_t pid = getpid();
+  int32_t old = ring->producer.load(std::memory_order_acquire);
+  while (old != pid) {
+    if (old != 0 && (kill(old, 0) == 0 || errno != ESRCH)) {
+      munmap(ring, sizeof(CmdRing));
+      return nullptr;
+    }
+    if (ring->producer.compare_exchange_weak(old, pid,
+                                             std::memory_order_acq_rel)) {
+      break;
+    }
+  }
+  return ring;
+}
+
+void cmd_ring_close(CmdRing *ring) {
+  int32_t pid = getpid();
+  ring->producer.compare_exchange_strong(pid, 0, std::memory_order_acq_rel);
+  munmap(ring, sizeof(CmdRing));
+}
+
+bool cmd_ring_push(CmdRing *ring, const RingCommand &cmd) {
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  if (head - ring->tail.load(std::memory_order_acquire) >= CMD_RING_SLOTS) {
+    ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  ring->slot[head % CMD_RING_SLOTS] = cmd;
+  ring->head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+int cmd_ring_pop_latest(CmdRing *ring, RingCommand *cmd) {
+  uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+  uint64_t head = ring->head.load(std::memory_order_acquire);
+  if (head == tail) {
+    return 0;
+  }
+  if (head - tail > CMD_RING_SLOTS) {
+    // only a broken producer gets here, take what is in the slots
+    tail = head - CMD_RING_SLOTS;
+  }
+  *cmd = ring->slot[(head - 1) % CMD_RING_SLOTS];
+  ring->tail.store(head, std::memory_order_release);
+  return head - tail;
+}
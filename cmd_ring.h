@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+#define CMD_RING_SHM "/toy_car_cmd_ring"
+#define CMD_RING_VERSION 1
+// a power of two
+#define CMD_RING_SLOTS 64
+
+// One command as a commander in another process produced it, with the
+// hints the loop would have asked that commander for. Both clocks are
+// system wide, so the times mean the same in either process.
+struct RingCommand {
+  uint64_t seq;
+  // monotonic_ns() when the host pushed it
+  uint64_t sent_ns;
+  // cmd_stamp(), lguTimestamp() ns, 0 if none
+  uint64_t stamp;
+  // cmd_deadline(), monotonic_ns(), 0 if none
+  uint64_t deadline;
+  char cmd[16];
+  int32_t has_engine;
+  uint32_t engine[3];
+  int32_t has_drive;
+  int32_t drive[2];
+};
+
+// Single producer, single consumer ring in shared memory: the host process
+// only writes head, the car only writes tail, neither ever waits for the
+// other. A full ring drops the new command, the car only runs the newest
+// anyway.
+struct CmdRing {
+  uint32_t version;
+  uint32_t slots;
+  // pid of the host holding the producer end, 0 if none
+  std::atomic<int32_t> producer;
+  alignas(64) std::atomic<uint64_t> head;
+  std::atomic<uint64_t> dropped;
+  alignas(64) std::atomic<uint64_t> tail;
+  alignas(64) RingCommand slot[CMD_RING_SLOTS];
+};
+
+// The car's end: creates or reuses CMD_RING_SHM and skips whatever an
+// earlier run left unread. Returns nullptr on failure.
+CmdRing *cmd_ring_consumer_open();
+// The host's end. Returns nullptr if no car has set the ring up, or
+// another live host holds the producer end.
+CmdRing *cmd_ring_producer_open();
+void cmd_ring_close(CmdRing *ring);
+// Returns false if the ring was full and the command dropped.
+bool cmd_ring_push(CmdRing *ring, const RingCommand &cmd);
+// Takes everything queued and copies the newest into *cmd. Returns how
+// many commands were taken.
+int cmd_ring_pop_latest(CmdRing *ring, RingCommand *cmd);
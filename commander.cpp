@@ -12,24 +12,128 @@
 //
 // Copyright Drew Noakes 2013-2016
 #include "commander.h"
+#include "arena.h"
+#include "car.h"
+#include "cmd_ring.h"
+#include "control.h"
+#include "deadline.h"
+#include "escape.h"
+#include "gamepad.h"
+#include "grid.h"
+#include "histogram.h"
 #include "joystick.h"
+#include "mixer.h"
+#include "perf_counters.h"
+#include "phase.h"
+#include "planner.h"
+#include "scanner.h"
 #include "sonar.h"
+#include "speed.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
-#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <cstring>
+#include <mutex>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
 extern "C" {
 #include "lgpio.h"
 }
+
+// how long a command stays good without its source being checked again:
+// the pad found still there, a new sensor reading, a typed line
+#define JS_INPUT_TIMEOUT_NS 1000000000ULL
+#define TERMINAL_CMD_TIMEOUT_NS 1000000000ULL
+#define SENSOR_CMD_TIMEOUT_NS 300000000ULL
+// a longer gap between autopilot ticks means the car was driven by hand
+// or carried, dead reckoning has lost it
+#define AUTO_GAP_NS 500000000ULL
+// HC-SR04 wants about 50ms between pings for the echoes to die down
+#define SONAR_GUARD_PERIOD_NS 50000000ULL
+// emergency stops the guard can keep before the loop prints them
+#define ESTOP_EVENTS 16
+// the narrowest way out a scan of the front may pick
+#define SCAN_MIN_SECTOR_DEG 45
+#define SONAR_HALF_BEAM (7.5 * M_PI / 180)
+
+std::string joystick_cmd(int x, int y, bool sonar_on) {
+  if (sonar_on) {
+    return "auto_sonar";
+  }
+  if (x == 0 && y == 0) {
+    return "brake";
+  }
+  if (x < 0) {
+    return "forward";
+  }
+  if (y == 0) {
+    return "backward";
+  } else if (y < 0) {
+    return "right";
+  } else {
+    return "left";
+  }
+}
+
+std::string infrared_cmd(int32_t v1, int32_t v2, int32_t v3, int32_t v4) {
+  if (v4 == 0) {
+    return "right";
+  }
+  if (v1 == 0) {
+    return "left";
+  }
+  if (v2 == 0 && v3 == 0) {
+    return "forward";
+  }
+  if (v2 == 0) {
+    return "left";
+  }
+  if (v3 == 0) {
+    return "right";
+  }
+  return "backward";
+}
+
+// Reads the gamepad through evdev, or through the old js interface when
+// there is no evdev device or input is "js". In analog mode the stick is
+// mixed into a duty per side instead of the five command words.
 class JsCommander : public Commander {
 public:
-  JsCommander(std::string path) : js_(path), path_(path) {}
+  JsCommander(const char *path, const char *input, bool analog,
+              uint64_t timeout_ns, std::pmr::memory_resource *mr)
+      : js_(""), path_(path, mr), input_(input ? input : "", mr),
+        use_evdev_(input_ != "js"), analog_(analog), timeout_ns_(timeout_ns) {}
   ~JsCommander() {}
+  bool drive_hint(int32_t *left, int32_t *right) override {
+    *left = left_;
+    *right = right_;
+    return analog_;
+  }
   std::string scan_cmd() override {
+    TRACE_SPAN("JsCommander::scan_cmd");
+    stamp_ = 0;
     reload_if_need();
+    if (pad_.is_open()) {
+      return scan_pad();
+    }
     if (!js_.isFound()) {
-      return "fallback_terminal";
+      // 命令词不超过15个字符，std::string不用分配堆内存
+      return "fallback";
     }
     JoystickEvent event;
     while (js_.sample(&event)) {
+      uint64_t at = event_time(event.time);
+      if (!event.isInitialState() && (stamp_ == 0 || at < stamp_)) {
+        stamp_ = at;
+      }
       if (event.isButton()) {
         if (event.number == 2)  {
           sonar_on_ = event.value;
@@ -45,43 +149,95 @@ public:
         y_ = event.value;
       }
     }
+    if (!js_.isFound()) {
+      // unplugged while reading
+      x_ = y_ = 0;
+      sonar_on_ = false;
+      return "brake";
+    }
+    alive_ = monotonic_ns();
     //printf("x=%d y=%d\n", x_, y_);
     return make_cmd();
   }
+  uint64_t cmd_stamp() override { return stamp_; }
+  // The pads only report changes, a stick held still sends nothing, so
+  // the command lasts as long as the device is there. It runs out when
+  // the loop stops looking, or the device went away and the loop has
+  // not got to that yet.
+  uint64_t cmd_deadline() override { return alive_ + timeout_ns_; }
 
 private:
-  std::string make_cmd() {
-    if (sonar_on_) {
-      return "auto_sonar";
+  std::string scan_pad() {
+    uint64_t first = 0;
+    if (pad_.poll(&first)) {
+      stamp_ = first;
     }
-    if (x_ == 0 && y_ == 0) {
+    if (!pad_.is_open()) {
+      x_ = y_ = 0;
+      sonar_on_ = false;
       return "brake";
     }
-    if (x_ < 0) {
-      return "forward";
+    // same numbering as js0
+    x_ = pad_.axis(4);
+    y_ = pad_.axis(5);
+    sonar_on_ = pad_.button(2);
+    alive_ = monotonic_ns();
+    return make_cmd();
+  }
+  std::string make_cmd() {
+    if (!analog_ || sonar_on_) {
+      return joystick_cmd(x_, y_, sonar_on_);
     }
-    if (y_ == 0) {
-      return "backward";
-    } else if (y_ < 0) {
-      return "right";
-    } else {
-      return "left";
+    // stick up (x < 0) is forward and y < 0 is right, as in joystick_cmd
+    mixer_.mix(-x_, -y_, &left_, &right_);
+    return left_ || right_ ? "drive" : "brake";
+  }
+  // The driver stamps events in milliseconds of its own clock. The
+  // smallest gap to lguTimestamp() seen so far is the offset between the
+  // two, give or take the millisecond. A jump of more than a minute is the
+  // 32 bit counter wrapping or the clock being set.
+  uint64_t event_time(uint32_t ms) {
+    int64_t now = lguTimestamp();
+    int64_t gap = now - static_cast<int64_t>(ms) * 1000000;
+    if (!synced_ || gap < clock_offset_ ||
+        gap - clock_offset_ > 60000000000LL) {
+      clock_offset_ = gap;
+      synced_ = true;
     }
+    return static_cast<int64_t>(ms) * 1000000 + clock_offset_;
   }
   void reload_if_need() {
-    if (js_.isFound()) {
+    if (pad_.is_open() || js_.isFound()) {
+      return;
+    }
+    if (use_evdev_ && pad_.open(input_.c_str()) == 0) {
+      PhaseScope log(PHASE_LOG);
+      std::cout << "gamepad: " << pad_.name() << std::endl;
       return;
     }
     js_.~Joystick();
-    new (&js_) Joystick(path_);
+    new (&js_) Joystick(std::string(path_.data(), path_.size()));
   }
 
 private:
   int x_{0};
   int y_{0};
   bool sonar_on_{false};
+  uint64_t stamp_{0};
+  int64_t clock_offset_{0};
+  bool synced_{false};
+  Gamepad pad_;
   Joystick js_;
-  std::string path_;
+  std::pmr::string path_;
+  std::pmr::string input_;
+  bool use_evdev_;
+  bool analog_;
+  uint64_t timeout_ns_;
+  // last scan that found the device working
+  uint64_t alive_{0};
+  DriveMixer mixer_;
+  int32_t left_{0};
+  int32_t right_{0};
 };
 
 class TerminalCommander : public Commander {
@@ -89,10 +245,17 @@ public:
   TerminalCommander() {}
   ~TerminalCommander() {}
   std::string scan_cmd() override {
+    TRACE_SPAN("TerminalCommander::scan_cmd");
     std::string cmd;
     std::cin >> cmd;
+    deadline_ = monotonic_ns() + TERMINAL_CMD_TIMEOUT_NS;
     return cmd;
   }
+  // a typed command runs for a while, not until the next line
+  uint64_t cmd_deadline() override { return deadline_; }
+
+private:
+  uint64_t deadline_{0};
 };
 
 class InfraredCommander : public Commander {
@@ -104,31 +267,28 @@ public:
   }
   ~InfraredCommander() {}
   std::string scan_cmd() override {
+    TRACE_SPAN("InfraredCommander::scan_cmd");
     int v1 = lgGpioRead(io_handle_, p1_);
     int v2 = lgGpioRead(io_handle_, p2_);
     int v3 = lgGpioRead(io_handle_, p3_);
     int v4 = lgGpioRead(io_handle_, p4_);
+    deadline_ = monotonic_ns() + SENSOR_CMD_TIMEOUT_NS;
+    v_[0] = v1;
+    v_[1] = v2;
+    v_[2] = v3;
+    v_[3] = v4;
     return make_cmd(v1, v2, v3, v4);
   }
+  void fill_state(CarState *state) override {
+    for (int i = 0; i < CAR_STATE_IR; i++) {
+      state->ir[i] = v_[i];
+    }
+  }
+  uint64_t cmd_deadline() override { return deadline_; }
 
 private:
   std::string make_cmd(int32_t v1, int32_t v2, int32_t v3, int32_t v4) {
-    if (v4 == 0) {
-      return "right";
-    }
-    if (v1 == 0) {
-      return "left";
-    }
-    if (v2 == 0 && v3 == 0) {
-      return "forward";
-    }
-    if (v2 == 0) {
-      return "left";
-    }
-    if (v3 == 0) {
-      return "right";
-    }
-    return "backward";
+    return infrared_cmd(v1, v2, v3, v4);
   }
   void set_all_port_input() {
     lgGpioClaimInput(io_handle_, LG_SET_PULL_UP, p1_);
@@ -139,63 +299,874 @@ private:
 
 private:
   int32_t io_handle_;
+  uint64_t deadline_{0};
+  int32_t v_[CAR_STATE_IR]{-1, -1, -1, -1};
   uint32_t p1_;
   uint32_t p2_;
   uint32_t p3_;
   uint32_t p4_;
 };
 
-class SonarCommander : public Commander {
+// Commands from another process over a Unix domain SOCK_SEQPACKET socket,
+// see control.h. One client at a time, a new one takes over. Returns ""
+// without a client and "idle" while the client has no live command.
+class ControlCommander : public Commander {
 public:
-  SonarCommander(uint32_t p1, uint32_t p2) : sonar_(p1, p2) {
-    for (uint32_t i = 1; i <= 32; i++) {
-      std::string dir = i % 2 ? "right" : "left";
-      for (uint32_t j = 0; j < i*3; j++) {
-        lookup_algo_.push_back(dir);
+  ControlCommander(const char *path, std::pmr::memory_resource *mr)
+      : path_(path, mr) {
+    listen_fd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    unlink(path);
+    if (listen_fd_ < 0 ||
+        bind(listen_fd_, reinterpret_cast<struct sockaddr *>(&addr),
+             sizeof(addr)) ||
+        listen(listen_fd_, 1)) {
+      std::cout << "failed to open control socket " << path << std::endl;
+      if (listen_fd_ >= 0) {
+        close(listen_fd_);
+      }
+      listen_fd_ = -1;
+    }
+  }
+  ~ControlCommander() {
+    if (client_fd_ >= 0) {
+      close(client_fd_);
+    }
+    if (listen_fd_ >= 0) {
+      close(listen_fd_);
+      unlink(path_.c_str());
+    }
+  }
+  int poll_fd() override { return client_fd_ >= 0 ? client_fd_ : listen_fd_; }
+  std::string scan_cmd() override {
+    TRACE_SPAN("ControlCommander::scan_cmd");
+    accept_client();
+    if (client_fd_ < 0) {
+      return "";
+    }
+    ControlCommand in;
+    while (true) {
+      // a short packet leaves the rest zero, not the last command's, and
+      // MSG_TRUNC gives the real length of a long one
+      memset(&in, 0, sizeof(in));
+      ssize_t bytes =
+          recv(client_fd_, &in, sizeof(in), MSG_DONTWAIT | MSG_TRUNC);
+      if (bytes < 0 && errno == EINTR) {
+        continue;
+      }
+      if (bytes < 0 && errno == EAGAIN) {
+        break;
+      }
+      if (bytes <= 0) {
+        drop_client();
+        return "";
+      }
+      uint64_t now = monotonic_ns();
+      if (bytes != sizeof(in) || in.version != CONTROL_VERSION ||
+          in.op > CONTROL_DRIVE) {
+        ack(in.seq, CONTROL_INVALID, now, 0);
+        continue;
+      }
+      if (pending_) {
+        ack(cmd_.seq, CONTROL_SUPERSEDED, received_ns_, 0);
+      }
+      cmd_ = in;
+      pending_ = true;
+      received_ns_ = now;
+      deadline_ =
+          now + (in.ttl_ms ? in.ttl_ms : CONTROL_DEFAULT_TTL_MS) * 1000000ULL;
+    }
+    if (deadline_ == 0 || monotonic_ns() >= deadline_) {
+      // nothing new while the last command ran out, the car is braked by
+      // the watchdog and the other sources may drive
+      if (pending_) {
+        ack(cmd_.seq, CONTROL_STALE, received_ns_, 0);
+        pending_ = false;
       }
+      deadline_ = 0;
+      return "idle";
+    }
+    return make_cmd();
+  }
+  bool drive_hint(int32_t *left, int32_t *right) override {
+    if (cmd_.op == CONTROL_VELOCITY) {
+      Car::velocity_duties(cmd_.a / 1000.0, cmd_.b / 1000.0, left, right);
+    } else {
+      *left = cmd_.a;
+      *right = cmd_.b;
+    }
+    return cmd_.op == CONTROL_VELOCITY || cmd_.op == CONTROL_DRIVE;
+  }
+  uint64_t cmd_deadline() override { return deadline_; }
+  void applied(uint64_t applied_ns, bool stale) override {
+    if (!pending_) {
+      return;
+    }
+    ack(cmd_.seq, stale ? CONTROL_STALE : CONTROL_APPLIED, received_ns_,
+        stale ? 0 : applied_ns);
+    pending_ = false;
+  }
+
+private:
+  std::string make_cmd() {
+    switch (cmd_.op) {
+    case CONTROL_FORWARD:
+      return "forward";
+    case CONTROL_BACKWARD:
+      return "backward";
+    case CONTROL_LEFT:
+      return "left";
+    case CONTROL_RIGHT:
+      return "right";
+    case CONTROL_VELOCITY:
+    case CONTROL_DRIVE:
+      return "drive";
+    default:
+      return "brake";
+    }
+  }
+  void accept_client() {
+    if (listen_fd_ < 0) {
+      return;
+    }
+    int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      return;
     }
+    // a planner that restarts takes over from its old connection
+    drop_client();
+    client_fd_ = fd;
+    PhaseScope log(PHASE_LOG);
+    std::cout << "control socket: client connected" << std::endl;
+  }
+  void drop_client() {
+    if (client_fd_ < 0) {
+      return;
+    }
+    close(client_fd_);
+    client_fd_ = -1;
+    pending_ = false;
+    deadline_ = 0;
+    PhaseScope log(PHASE_LOG);
+    std::cout << "control socket: client gone" << std::endl;
+  }
+  void ack(uint32_t seq, int32_t status, uint64_t received_ns,
+           uint64_t applied_ns) {
+    ControlAck out;
+    out.seq = seq;
+    out.status = status;
+    out.received_ns = received_ns;
+    out.applied_ns = applied_ns;
+    // a client that does not read its acks loses them, the car never waits
+    send(client_fd_, &out, sizeof(out), MSG_DONTWAIT | MSG_NOSIGNAL);
+  }
+
+private:
+  std::pmr::string path_;
+  int listen_fd_{-1};
+  int client_fd_{-1};
+  ControlCommand cmd_{};
+  // cmd_ has not been acknowledged yet
+  bool pending_{false};
+  uint64_t received_ns_{0};
+  uint64_t deadline_{0};
+};
+
+// Commands a toy_car_host process pushes into the shared memory ring, see
+// cmd_ring.h. Nothing the host does can hold up the loop: a host that
+// hangs or dies only stops sending, and its last command runs out.
+// Returns "" while there is no live command.
+class RingCommander : public Commander {
+public:
+  RingCommander() : ring_(cmd_ring_consumer_open()) {
+    if (!ring_) {
+      std::cout << "failed to open shared memory " << CMD_RING_SHM
+                << std::endl;
+    }
+  }
+  ~RingCommander() {
+    if (!ring_) {
+      return;
+    }
+    if (taken_) {
+      std::cout << "command ring: " << taken_ << " commands, " << ran_
+                << " taken by the loop, " << ring_->dropped.load()
+                << " dropped when full, lag p50 " << lag_.percentile(50) / 1000
+                << "us p99 " << lag_.percentile(99) / 1000 << "us max "
+                << lag_.max() / 1000 << "us" << std::endl;
+    }
+    cmd_ring_close(ring_);
   }
-  ~SonarCommander() {}
   std::string scan_cmd() override {
-    double cur_distance = sonar_.get_distance();
-    std::cout<<"distance:"<<cur_distance<<std::endl;
-    if (cur_distance > safe_distance_) {
-      state_ = WALK;
+    TRACE_SPAN("RingCommander::scan_cmd");
+    if (!ring_) {
+      return "";
+    }
+    int count = cmd_ring_pop_latest(ring_, &cmd_);
+    uint64_t now = monotonic_ns();
+    if (count) {
+      cmd_.cmd[sizeof(cmd_.cmd) - 1] = 0;
+      taken_ += count;
+      ran_++;
+      lag_.add(now > cmd_.sent_ns ? now - cmd_.sent_ns : 0);
     } else {
-      if (state_ != LOOKUP) {
-        state_ = LOOKUP;
-        lookup_cursor_ = 0;
-        return "brake";
+      // the event behind it already went to the wheels
+      cmd_.stamp = 0;
+    }
+    if (cmd_.deadline == 0 || now >= cmd_.deadline) {
+      return "";
+    }
+    return cmd_.cmd;
+  }
+  bool engine_hint(uint32_t *f_speed, uint32_t *b_speed,
+                   uint32_t *t_speed) override {
+    if (!cmd_.has_engine) {
+      return false;
+    }
+    *f_speed = cmd_.engine[0];
+    *b_speed = cmd_.engine[1];
+    *t_speed = cmd_.engine[2];
+    return true;
+  }
+  bool drive_hint(int32_t *left, int32_t *right) override {
+    *left = cmd_.drive[0];
+    *right = cmd_.drive[1];
+    return cmd_.has_drive;
+  }
+  uint64_t cmd_stamp() override { return cmd_.stamp; }
+  uint64_t cmd_deadline() override { return cmd_.deadline; }
+
+private:
+  CmdRing *ring_;
+  RingCommand cmd_{};
+  uint64_t taken_{0};
+  uint64_t ran_{0};
+  // host push to loop
+  Histogram lag_;
+};
+
+static double median3(double a, double b, double c) {
+  return std::max(std::min(a, b), std::min(std::max(a, b), c));
+}
+
+class SonarCommander : public Commander {
+public:
+  SonarCommander(uint32_t p1, uint32_t p2, const AutopilotParams &params,
+                 std::pmr::memory_resource *mr)
+      : sonar_(p1, p2), safe_distance_(params.safe_distance),
+        lookup_algo_(mr),
+        speed_(params.min_speed, params.max_speed, params.safe_distance,
+               params.ttc_brake),
+        cruise_(params.cruise),
+        cruise_speed_(params.min_speed), min_speed_(params.min_speed),
+        turn_speed_(params.turn_speed), sweep_(params.sweep),
+        max_resweeps_(params.max_resweeps),
+        turn_rate_dps_(params.turn_rate_dps), odom_(turn_rate_dps_),
+        stall_ns_(static_cast<uint64_t>(params.stall_time * 1e9)) {
+    if (grid_.open(params.map_path, 20, 20, 0.05)) {
+      std::cout << "failed to open occupancy grid " << params.map_path
+                << std::endl;
+    }
+    // the saved pose only holds for a run that starts in auto mode where
+    // the last one stopped, and only until the car is driven otherwise.
+    // Until a clean exit says where the car is, a crash leaves no pose.
+    Pose start;
+    if (grid_.saved_pose(&start)) {
+      odom_.reset(start);
+    }
+    grid_.save_pose(nullptr);
+    grid_.sync();
+    if (params.goal) {
+      if (route_.init() || route_.set_goal(params.goal_x, params.goal_y)) {
+        std::cout << "goal " << params.goal_x << "," << params.goal_y
+                  << " is off the map" << std::endl;
+      } else {
+        goal_ = true;
       }
     }
+    last_scan_ = monotonic_ns();
+    for (uint32_t i = 1; i <= 32; i++) {
+      lookup_algo_.append(i * params.lookup_growth, i % 2 ? 'r' : 'l');
+    }
+    if (params.scan_servo >= 0) {
+      scanner_ = arena_new<PanScanner>(mr, &sonar_, params.scan_servo);
+    }
+  }
+  ~SonarCommander() {
+    if (monotonic_ns() - last_scan_ <= AUTO_GAP_NS) {
+      grid_.save_pose(&odom_.pose());
+      grid_.sync();
+    }
+    bool guarded = guarding_;
+    if (guarded) {
+      guarding_ = false;
+      guard_.join();
+    }
+    arena_delete(scanner_);
+    std::cout << "sonar missed echoes: " << sonar_.missed() << std::endl;
+    if (!guarded) {
+      return;
+    }
+    print_estops();
+    std::cout << "sonar emergency stops: " << estop_latency_.count()
+              << ", reaction p50 " << estop_latency_.percentile(50) / 1000
+              << "us p99 " << estop_latency_.percentile(99) / 1000
+              << "us max " << estop_latency_.max() / 1000 << "us"
+              << std::endl;
+  }
+  int set_emergency_stop(EmergencyStop *stop, double limit_m) override {
+    if (guarding_) {
+      return -1;
+    }
+    estop_ = stop;
+    estop_m_ = limit_m;
+    guarding_ = true;
+    guard_ = std::thread(&SonarCommander::guard, this);
+    return 0;
+  }
+  bool engine_hint(uint32_t *f_speed, uint32_t *b_speed,
+                   uint32_t *t_speed) override {
+    *f_speed = std::max(cruise_speed_, min_speed_);
+    *b_speed = min_speed_;
+    *t_speed = turn_speed_;
+    return true;
+  }
+  uint64_t cmd_deadline() override { return deadline_; }
+  void fill_state(CarState *state) override {
+    state->sonar_m = guarding_ ? guard_distance_.load() : last_distance_;
+  }
+  std::string scan_cmd() override {
+    TRACE_SPAN("SonarCommander::scan_cmd");
+    PhaseScope scan(PHASE_SCAN);
+    uint64_t mono = monotonic_ns();
+    if (mono - last_scan_ > AUTO_GAP_NS) {
+      lost_pose();
+    }
+    last_scan_ = mono;
+    if (guarding_) {
+      PhaseScope log(PHASE_LOG);
+      print_estops();
+    }
+    // with the guard running the sonar belongs to its thread
+    double cur_distance =
+        guarding_ ? guard_distance_.load() : sonar_.get_distance();
+    if (cur_distance < 0) {
+      return "brake";
+    }
+    last_distance_ = cur_distance;
+    deadline_ = monotonic_ns() + SENSOR_CMD_TIMEOUT_NS;
+    uint64_t now = lguTimestamp();
+    {
+      PhaseScope log(PHASE_LOG);
+      std::cout<<"distance:"<<cur_distance<<std::endl;
+    }
+    odom_.advance(now);
+    // the echo is the nearest thing anywhere in the beam, about 15 degrees
+    // wide
+    for (int ray = -1; ray <= 1; ray++) {
+      grid_.integrate(odom_.pose(), ray * SONAR_HALF_BEAM, cur_distance);
+    }
+    if (++grid_updates_ % 50 == 0) {
+      grid_.sync();
+    }
+    PhaseScope decide_phase(PHASE_DECIDE);
+    std::string cmd = decide(cur_distance, now);
+    odom_.set_cmd(cmd, std::max(cruise_speed_, min_speed_));
+    return cmd;
+  }
+
+private:
+  // Back in auto mode after the car went where dead reckoning did not
+  // follow: the old map no longer lines up, start a new one from here.
+  void lost_pose() {
+    Pose origin = {0, 0, 0};
+    odom_.reset(origin);
+    grid_.clear();
+    PhaseScope log(PHASE_LOG);
+    std::cout << "grid: pose lost outside auto mode, new map" << std::endl;
+  }
+  // Pings on its own clock, not the loop's, and stops the car as soon as
+  // the median of the last three readings is under the limit. A median
+  // lets one stray echo through neither way.
+  void guard() {
+    trace_thread();
+    perf_thread("sonar guard");
+    double window[3] = {0, 0, 0};
+    uint32_t readings = 0;
+    bool blocked = false;
+    uint64_t next = monotonic_ns();
+    while (guarding_) {
+      double d = 0;
+      {
+        // the car stands braked while the scanner has the sonar
+        std::unique_lock<std::mutex> lock(sonar_mutex_, std::try_to_lock);
+        if (lock.owns_lock()) {
+          d = sonar_.get_distance();
+        }
+      }
+      uint64_t at = monotonic_ns();
+      // 0 is a lost echo, not an obstacle
+      if (d > 0) {
+        window[readings++ % 3] = d;
+        double filtered =
+            readings < 3 ? d : median3(window[0], window[1], window[2]);
+        guard_distance_ = filtered;
+        if (filtered < estop_m_) {
+          blocked = true;
+          if (estop_->emergency_stop()) {
+            uint64_t reaction = monotonic_ns() - at;
+            estop_latency_.add(reaction);
+            push_estop(filtered, reaction);
+          }
+        } else if (blocked && filtered > estop_m_ * 1.2) {
+          blocked = false;
+          estop_->emergency_clear();
+        }
+      }
+      // one ping and the sleep before it
+      perf_tick();
+      next += SONAR_GUARD_PERIOD_NS;
+      if (next <= at) {
+        next = at + SONAR_GUARD_PERIOD_NS;
+      }
+      std::this_thread::sleep_for(std::chrono::nanoseconds(next - at));
+    }
+  }
+
+  std::string decide(double cur_distance, uint64_t now) {
     if (state_ == WALK) {
+      if (arrived_) {
+        return "brake";
+      }
+      std::string way = goal_ ? route_cmd() : "forward";
+      if (way != "forward") {
+        // turning in place onto the path, the map has the walls. The
+        // reading sweeps across them, which is neither closing in nor a
+        // stall.
+        speed_.reset();
+        stall_distance_ = -1;
+        return way;
+      }
+      if (cruise_) {
+        cruise_speed_ = speed_.update(cur_distance, now);
+      } else {
+        cruise_speed_ = cur_distance > safe_distance_ ? min_speed_ : 0;
+      }
+      escape_start_ = now;
+      if (cruise_speed_ > 0 && stalled(cur_distance, now)) {
+        // 卡住了，先倒车离开，再找出路
+        std::cout << "stalled at distance:" << cur_distance << std::endl;
+        backoff_end_ = now + 500000000;
+        state_ = BACKOFF;
+        return "backward";
+      }
+      if (cruise_speed_ > 0) {
+        return "forward";
+      }
+      if (!cruise_) {
+        return begin_escape();
+      }
+      std::cout << "time to collision:" << speed_.time_to_collision()
+                << "s closing speed:" << speed_.closing_speed() << "m/s"
+                << std::endl;
+      // 被挡住了，先刹车，再开始找出路
+      return begin_escape();
+    }
+    if (state_ == BACKOFF) {
+      return now < backoff_end_ ? "backward" : begin_escape(true);
+    }
+    if (state_ == SWEEP) {
+      return sweep_cmd(cur_distance, now);
+    }
+    if (state_ == SCAN) {
+      return scan_escape();
+    }
+    if (state_ == TURN) {
+      if (now < turn_end_) {
+        return turn_dir_;
+      }
+      if (cur_distance > safe_distance_) {
+        return finish_escape(now);
+      }
+      if (resweeps_ >= max_resweeps_) {
+        // the sectors keep closing up, the sweeps do not see this place
+        // well enough
+        std::cout << "escape: still blocked after " << resweeps_
+                  << " more sweeps, fallback to zig-zag" << std::endl;
+        return begin_zigzag();
+      }
+      // the chosen sector closed up again, take another look around
+      resweeps_++;
+      sweep_start_ = 0;
+      planner_.reset();
+      state_ = escape_mode_ == ESCAPE_SCAN ? SCAN : SWEEP;
+      return "brake";
+    }
+    // turn at least once, a stalled car can see a free way straight ahead
+    if (lookup_cursor_ > 0 && cur_distance > safe_distance_) {
+      return finish_escape(now);
+    }
+    char dir = lookup_algo_[lookup_cursor_++ % lookup_algo_.size()];
+    return dir == 'r' ? "right" : "left";
+  }
+
+  // The way to the goal through what the map has seen so far, repaired
+  // after every reading. Without one the car goes where it is free and
+  // the map fills in.
+  std::string route_cmd() {
+    const Pose &pose = odom_.pose();
+    if (route_.set_start(pose.x, pose.y)) {
+      return "forward";
+    }
+    route_.update_from_grid(grid_);
+    if (!route_.replan()) {
       return "forward";
     }
-    return lookup_algo_[lookup_cursor_++ % lookup_algo_.size()];
+    Waypoint path[64];
+    follower_.set_path(path, route_.waypoints(path, 64));
+    std::string cmd = follower_.next_cmd(pose);
+    if (cmd == "brake") {
+      arrived_ = true;
+      std::cout << "goal reached at " << pose.x << "," << pose.y << std::endl;
+    }
+    return cmd;
+  }
+
+  // stalled: wedged on something the sonar does not see, a look ahead
+  // would pick the same way again
+  std::string begin_escape(bool stalled = false) {
+    if (!sweep_) {
+      return begin_zigzag();
+    }
+    resweeps_ = 0;
+    if (scanner_ && !stalled) {
+      // brakes first, the scan comes with the next tick
+      escape_mode_ = ESCAPE_SCAN;
+      state_ = SCAN;
+      return "brake";
+    }
+    return begin_sweep();
+  }
+
+  std::string begin_sweep() {
+    sweep_start_ = 0;
+    planner_.reset();
+    escape_mode_ = ESCAPE_SWEEP;
+    state_ = SWEEP;
+    return "brake";
+  }
+
+  // also where a sweep gives up, the escape is then timed as a zig-zag
+  std::string begin_zigzag() {
+    lookup_cursor_ = 0;
+    escape_mode_ = ESCAPE_ZIGZAG;
+    state_ = LOOKUP;
+    return "brake";
+  }
+
+  bool stalled(double cur_distance, uint64_t now) {
+    if (std::fabs(cur_distance - stall_distance_) > 0.02) {
+      stall_distance_ = cur_distance;
+      stall_since_ = now;
+      return false;
+    }
+    // a reading past 3m is the no-echo timeout and stays the same in open
+    // space too, only a long run without any echo counts as stuck then
+    uint64_t limit = cur_distance > 3.0 ? 4 * stall_ns_ : stall_ns_;
+    return now - stall_since_ > limit;
+  }
+
+  // one full clockwise turn, then straight back to the widest free sector
+  std::string sweep_cmd(double cur_distance, uint64_t now) {
+    if (sweep_start_ == 0) {
+      sweep_start_ = now;
+      planner_.add_sample(0, cur_distance);
+      return "right";
+    }
+    double heading = (now - sweep_start_) / 1e9 * turn_rate_dps_;
+    planner_.add_sample(heading, cur_distance);
+    if (heading < 360) {
+      return "right";
+    }
+
+    double target = 0;
+    double width = 0;
+    if (!planner_.select(safe_distance_, &target, &width)) {
+      std::cout << "escape: no free sector, fallback to zig-zag" << std::endl;
+      return begin_zigzag();
+    }
+    // the sweep ends facing the start heading, so the target is relative
+    // to the current heading too
+    return turn_to(target, width, now);
+  }
+
+  // Pans the sonar across the front instead of spinning the car. The loop
+  // waits out the sweep, about a second with the car braked, a third of
+  // what spinning round takes.
+  std::string scan_escape() {
+    ScanProfile scan;
+    {
+      std::lock_guard<std::mutex> lock(sonar_mutex_);
+      scanner_->sweep(&scan);
+      scanner_->center();
+    }
+    uint64_t now = lguTimestamp();
+    grid_.integrate(odom_.pose(), scan);
+    planner_.reset();
+    for (uint32_t i = 0; i < scan.count; i++) {
+      planner_.add_sample(scan.angle_deg[i], scan.range_m[i]);
+    }
+    // the sonar does not see behind the car, none of that is free
+    for (double h = 97.5; h < 270; h += 15) {
+      planner_.add_sample(h, 0);
+    }
+    // Only a clear way out ahead will do: the car stopped short of
+    // something that may still read free, and a narrow gap seen from here
+    // is likely too narrow for the car. Spinning round sees the rest.
+    double target = 0;
+    double width = 0;
+    if (!planner_.select(2 * safe_distance_, &target, &width) ||
+        width < SCAN_MIN_SECTOR_DEG) {
+      std::cout << "escape: no clear sector ahead, sweep around" << std::endl;
+      return begin_sweep();
+    }
+    return turn_to(target, width, now);
+  }
+
+  // target is clockwise from the current heading
+  std::string turn_to(double target, double width, uint64_t now) {
+    double turn = target;
+    turn_dir_ = "right";
+    if (turn > 180) {
+      turn = 360 - turn;
+      turn_dir_ = "left";
+    }
+    std::cout << "escape: widest sector " << width << " deg at " << target
+              << " deg, turn " << turn_dir_ << " " << turn << " deg"
+              << std::endl;
+    turn_end_ = now + static_cast<uint64_t>(turn / turn_rate_dps_ * 1e9);
+    state_ = TURN;
+    return turn_dir_;
+  }
+
+  std::string finish_escape(uint64_t now) {
+    // filed under the way the car got out, a sweep that gave up counts as
+    // a zig-zag
+    uint64_t cost = now - escape_start_;
+    EscapeStats &stats = escape_stats_[escape_mode_];
+    stats.count++;
+    stats.total += cost;
+    stats.max = std::max(stats.max, cost);
+    std::cout << "escape(" << ESCAPE_NAMES[escape_mode_]
+              << ") time to escape:" << cost / 1000000 << "ms"
+              << " avg:" << stats.total / stats.count / 1000000 << "ms"
+              << " max:" << stats.max / 1000000 << "ms"
+              << " count:" << stats.count << std::endl;
+    state_ = WALK;
+    speed_.reset();
+    cruise_speed_ = min_speed_;
+    stall_since_ = now;
+    return "forward";
   }
 
 private:
   enum STATE {
     WALK = 1,
     LOOKUP = 2,
+    SWEEP = 3,
+    TURN = 4,
+    BACKOFF = 5,
+    SCAN = 6,
+  };
+  enum ESCAPE_MODE {
+    ESCAPE_SWEEP = 0,
+    ESCAPE_ZIGZAG = 1,
+    ESCAPE_SCAN = 2,
+    ESCAPE_MODES = 3,
+  };
+  static constexpr const char *ESCAPE_NAMES[ESCAPE_MODES] = {
+      "sweep", "zigzag", "scan"};
+  // time-to-escape metric, in nanoseconds
+  struct EscapeStats {
+    uint64_t count{0};
+    uint64_t total{0};
+    uint64_t max{0};
   };
   Sonar sonar_;
   STATE state_{WALK};
-  double safe_distance_{0.4};
+  double safe_distance_;
   uint32_t lookup_cursor_{0};
-  std::vector<std::string> lookup_algo_;
+  // one 'r' or 'l' per tick
+  std::pmr::string lookup_algo_;
+  // clearance and closing speed based cruise control
+  SpeedController speed_;
+  bool cruise_;
+  uint32_t cruise_speed_;
+  // The guard thread must not block on the terminal, it hands its stops
+  // to the loop through a ring and drops them when the ring is full.
+  void push_estop(double distance_m, uint64_t reaction_ns) {
+    uint32_t head = estop_head_.load(std::memory_order_relaxed);
+    if (head - estop_tail_.load(std::memory_order_acquire) >= ESTOP_EVENTS) {
+      estop_dropped_++;
+      return;
+    }
+    estop_events_[head % ESTOP_EVENTS] = {distance_m, reaction_ns};
+    estop_head_.store(head + 1, std::memory_order_release);
+  }
+  void print_estops() {
+    uint32_t tail = estop_tail_.load(std::memory_order_relaxed);
+    uint32_t head = estop_head_.load(std::memory_order_acquire);
+    for (; tail != head; tail++) {
+      const EstopEvent &e = estop_events_[tail % ESTOP_EVENTS];
+      std::cout << "emergency stop at " << e.distance_m << "m, reaction "
+                << e.reaction_ns / 1000 << "us" << std::endl;
+    }
+    estop_tail_.store(tail, std::memory_order_release);
+    uint32_t dropped = estop_dropped_.exchange(0);
+    if (dropped) {
+      std::cout << "emergency stops not printed: " << dropped << std::endl;
+    }
+  }
+
+  uint32_t min_speed_;
+  uint32_t turn_speed_;
+  // sweep-and-select escape
+  bool sweep_;
+  uint32_t max_resweeps_;
+  uint32_t resweeps_{0};
+  EscapePlanner planner_;
+  // pans the sonar, null if it is fixed to the chassis
+  PanScanner *scanner_{nullptr};
+  // held by whoever pings, the scanner or the guard
+  std::mutex sonar_mutex_;
+  double turn_rate_dps_;
+  // sonar readings are kept in the occupancy grid, placed by dead reckoning
+  DeadReckoning odom_;
+  OccupancyGrid grid_;
+  uint64_t grid_updates_{0};
+  // driving to a goal of the map, see AutopilotParams::goal
+  GridPlanner route_{grid_, 0.2};
+  WaypointFollower follower_;
+  bool goal_{false};
+  bool arrived_{false};
+  // monotonic_ns() of the last autopilot tick
+  uint64_t last_scan_{0};
+  // stall detection
+  uint64_t stall_ns_;
+  uint64_t stall_since_{0};
+  double stall_distance_{0};
+  uint64_t backoff_end_{0};
+  uint64_t sweep_start_{0};
+  uint64_t turn_end_{0};
+  std::string turn_dir_;
+  uint64_t escape_start_{0};
+  ESCAPE_MODE escape_mode_{ESCAPE_SWEEP};
+  EscapeStats escape_stats_[ESCAPE_MODES];
+  uint64_t deadline_{0};
+  double last_distance_{-1};
+  // emergency stop, the histogram belongs to the guard thread
+  EmergencyStop *estop_{nullptr};
+  double estop_m_{0};
+  std::atomic<bool> guarding_{false};
+  std::atomic<double> guard_distance_{-1};
+  Histogram estop_latency_;
+  // written by the guard, printed by the loop
+  struct EstopEvent {
+    double distance_m;
+    uint64_t reaction_ns;
+  };
+  EstopEvent estop_events_[ESTOP_EVENTS];
+  std::atomic<uint32_t> estop_head_{0};
+  std::atomic<uint32_t> estop_tail_{0};
+  std::atomic<uint32_t> estop_dropped_{0};
+  std::thread guard_;
 };
 
-Commander *make_commander(std::string type) {
+// name in the directory the running binary is in, name alone if that is
+// not known
+static std::string beside_binary(const char *name) {
+  char exe[PATH_MAX];
+  ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+  if (n <= 0) {
+    return name;
+  }
+  exe[n] = 0;
+  char *slash = strrchr(exe, '/');
+  if (!slash) {
+    return name;
+  }
+  slash[1] = 0;
+  return std::string(exe) + name;
+}
+
+// The autopilot as set up for this car.
+static AutopilotParams autopilot_params() {
+  AutopilotParams params;
+  const char *rate = getenv("TOY_CAR_TURN_RATE");
+  if (rate && atof(rate) > 0) {
+    params.turn_rate_dps = atof(rate);
+  }
+  // sudo and services start anywhere, the map stays with the binary
+  const char *map = getenv("TOY_CAR_MAP");
+  params.map_path = map ? map : beside_binary("toy_car.map");
+  const char *goal = getenv("TOY_CAR_GOAL");
+  if (goal && sscanf(goal, "%lf,%lf", &params.goal_x, &params.goal_y) == 2) {
+    params.goal = true;
+  }
+  const char *servo = getenv("TOY_CAR_SCAN_SERVO");
+  if (servo) {
+    params.scan_servo = atoi(servo);
+  }
+  return params;
+}
+
+Commander *make_commander(std::string type, std::pmr::memory_resource *mr) {
   if (type == "joystick") {
-    return new JsCommander("/dev/input/js0");
+    const char *drive = getenv("TOY_CAR_DRIVE");
+    const char *timeout = getenv("TOY_CAR_INPUT_TIMEOUT");
+    uint64_t timeout_ns = timeout && atof(timeout) > 0
+                              ? static_cast<uint64_t>(atof(timeout) * 1e9)
+                              : JS_INPUT_TIMEOUT_NS;
+    return make_joystick_commander("/dev/input/js0", getenv("TOY_CAR_INPUT"),
+                                   drive && !strcmp(drive, "analog"),
+                                   timeout_ns, mr);
   } else if (type == "terminal") {
-    return new TerminalCommander();
+    return arena_new<TerminalCommander>(mr);
+  } else if (type == "socket") {
+    const char *path = getenv("TOY_CAR_SOCKET");
+    return make_socket_commander(path ? path : CONTROL_SOCKET_PATH, mr);
+  } else if (type == "ring") {
+    return arena_new<RingCommander>(mr);
   } else if (type == "infrared") {
-    return new InfraredCommander(25, 8, 7, 1);
+    return arena_new<InfraredCommander>(mr, 25, 8, 7, 1);
   } else if (type == "sonar") {
-    return new SonarCommander(14, 15);
+    return make_sonar_commander(14, 15, autopilot_params(), mr);
+  } else if (type == "sonar_zigzag") {
+    AutopilotParams params = autopilot_params();
+    params.sweep = false;
+    return make_sonar_commander(14, 15, params, mr);
   }
   return nullptr;
 }
-void destroy_commander(Commander *cmd) { delete cmd; }
\ No newline at end of file
+
+Commander *make_joystick_commander(const char *js_path, const char *input,
+                                   bool analog, uint64_t timeout_ns,
+                                   std::pmr::memory_resource *mr) {
+  return arena_new<JsCommander>(mr, js_path, input, analog, timeout_ns, mr);
+}
+
+Commander *make_socket_commander(const char *path,
+                                 std::pmr::memory_resource *mr) {
+  return arena_new<ControlCommander>(mr, path, mr);
+}
+
+Commander *make_sonar_commander(uint32_t trigger, uint32_t response,
+                                const AutopilotParams &params,
+                                std::pmr::memory_resource *mr) {
+  return arena_new<SonarCommander>(mr, trigger, response, params, mr);
+}
+void destroy_commander(Commander *cmd) { arena_delete(cmd); }
@@ -14,15 +14,119 @@
 
 #pragma once
 
+#include "car_state.h"
+#include <memory_resource>
+#include <stdint.h>
 #include <unistd.h>
 #include <string>
 
+// Stops the car right away, from any thread.
+class EmergencyStop {
+public:
+  virtual ~EmergencyStop() {}
+  // Brakes if the car is driving forward, into what the sensor sees, and
+  // keeps it from driving forward until emergency_clear(). Returns false
+  // if it was not driving forward.
+  virtual bool emergency_stop() = 0;
+  virtual void emergency_clear() = 0;
+};
+
 class Commander {
 public:
   Commander() {}
   virtual ~Commander() {}
   virtual std::string scan_cmd() = 0;
+  // Engine speeds the last command should run with. Returns false if the
+  // commander has no preference.
+  virtual bool engine_hint(uint32_t *f_speed, uint32_t *b_speed,
+                           uint32_t *t_speed) {
+    return false;
+  }
+  // Per side duties for a "drive" command, -100..100. Returns false if
+  // the commander does not drive analog.
+  virtual bool drive_hint(int32_t *left, int32_t *right) { return false; }
+  // lguTimestamp() of the input event behind the last command, 0 if it
+  // did not come from a new event.
+  virtual uint64_t cmd_stamp() { return 0; }
+  // monotonic_ns() past which the last command is stale and must not run,
+  // 0 if it does not go stale.
+  virtual uint64_t cmd_deadline() { return 0; }
+  // Watches the commander's range sensor from a thread of its own and
+  // calls stop the moment the reading drops under limit_m, whether or not
+  // the commander is the one driving. Returns -1 if it has no such sensor.
+  virtual int set_emergency_stop(EmergencyStop *stop, double limit_m) {
+    return -1;
+  }
+  // Adds the sensor readings the commander has to state.
+  virtual void fill_state(CarState *state) {}
+  // A descriptor that becomes readable when the commander has a new
+  // command, the loop wakes up for it instead of waiting out the tick.
+  // -1 if there is none.
+  virtual int poll_fd() { return -1; }
+  // The loop ran the last command at applied_ns (monotonic_ns()), or
+  // braked instead because it was stale.
+  virtual void applied(uint64_t applied_ns, bool stale) {}
 };
 
-Commander *make_commander(std::string type);
+// Tunables of the sonar autopilot.
+struct AutopilotParams {
+  // closer than this a heading is not free
+  double safe_distance{0.4};
+  // spin rate at turn_speed. The escape sweep and dead reckoning time
+  // their turns with it, there is no gyro: measure it with toy_car_spin on
+  // the floor the car drives on, TOY_CAR_TURN_RATE sets it.
+  double turn_rate_dps{120};
+  // auto-mode engine: cruise duty range and spin duty
+  uint32_t min_speed{20};
+  uint32_t max_speed{80};
+  uint32_t turn_speed{70};
+  // brake once the predicted time to collision drops below this
+  double ttc_brake{0.6};
+  // cruise duty from clearance and closing speed, or the old fixed
+  // min_speed up to safe_distance
+  bool cruise{true};
+  // each zig-zag swing is this many ticks longer than the last
+  uint32_t lookup_growth{3};
+  // driving forward without the sonar reading changing for this long
+  // means the car is wedged somewhere the sonar can't see
+  double stall_time{1.5};
+  // sweep-and-select escape, or the old zig-zag
+  bool sweep{true};
+  // sweeps after the first whose sector closes up again before the
+  // escape falls back to the zig-zag
+  uint32_t max_resweeps{2};
+  // gpio of a servo panning the sonar, -1 if the sonar is fixed to the
+  // chassis. With one the escape pans the sonar across the front instead
+  // of spinning the car, see PanScanner.
+  int32_t scan_servo{-1};
+  // occupancy grid file, empty keeps the map in memory only. The car's
+  // is TOY_CAR_MAP, toy_car.map next to the binary by default.
+  std::string map_path{"toy_car.map"};
+  // drive to this point of the map through GridPlanner instead of going
+  // wherever the way is free: meters from where the map started, x ahead
+  // and y to the left. The car's is TOY_CAR_GOAL="x,y".
+  bool goal{false};
+  double goal_x{0};
+  double goal_y{0};
+};
+
+// Command word for joystick axis values and the auto-drive button.
+std::string joystick_cmd(int x, int y, bool sonar_on);
+// Command word for the four infrared detectors, 0 means an obstacle.
+std::string infrared_cmd(int32_t v1, int32_t v2, int32_t v3, int32_t v4);
+
+// Commanders and everything they keep are placed in mr, they live as long
+// as it does. destroy_commander only runs the destructor.
+Commander *make_commander(std::string type, std::pmr::memory_resource *mr);
+// The pad: the evdev device input, "js" for the js device at js_path, or
+// null to look for a gamepad and fall back to js_path.
+Commander *make_joystick_commander(const char *js_path, const char *input,
+                                   bool analog, uint64_t timeout_ns,
+                                   std::pmr::memory_resource *mr);
+// Listens for one client on the control socket at path.
+Commander *make_socket_commander(const char *path,
+                                 std::pmr::memory_resource *mr);
+Commander *make_sonar_commander(uint32_t trigger, uint32_t response,
+                                const AutopilotParams &params,
+                                std::pmr::memory_resource *mr);
 void destroy_commander(Commander *cmd);
@@ -0,0 +1,50 @@
+#pragma once
+#include <stdint.h>
+
+// Binary protocol of the control socket, a Unix domain SOCK_SEQPACKET
+// endpoint: one ControlCommand per packet to the car, one ControlAck per
+// command back. Both ends run on the same machine, no byte swapping.
+
+#define CONTROL_SOCKET_PATH "/tmp/toy_car.sock"
+#define CONTROL_VERSION 1
+// how long a command stays good when ttl_ms is 0
+#define CONTROL_DEFAULT_TTL_MS 200
+
+enum ControlOp {
+  CONTROL_BRAKE = 0,
+  CONTROL_FORWARD = 1,
+  CONTROL_BACKWARD = 2,
+  CONTROL_LEFT = 3,
+  CONTROL_RIGHT = 4,
+  // a = linear, b = angular, both in 1/1000 of full, as Car::set_velocity
+  CONTROL_VELOCITY = 5,
+  // a = left, b = right duty, -100..100
+  CONTROL_DRIVE = 6,
+};
+
+enum ControlStatus {
+  CONTROL_APPLIED = 0,
+  // a newer command came in before the loop got to this one
+  CONTROL_SUPERSEDED = 1,
+  // past its deadline when the loop got to it, the car braked
+  CONTROL_STALE = 2,
+  CONTROL_INVALID = 3,
+};
+
+struct ControlCommand {
+  uint8_t version;
+  uint8_t op;
+  int16_t a;
+  int16_t b;
+  // the command runs out this long after it was received
+  uint16_t ttl_ms;
+  uint32_t seq;
+};
+
+struct ControlAck {
+  uint32_t seq;
+  int32_t status;
+  // CLOCK_MONOTONIC ns, comparable with the sender's own clock
+  uint64_t received_ns;
+  uint64_t applied_ns;
+};
@@ -0,0 +1,178 @@
+// Drives a running toy_car over its control socket, the way a planner in
+// another process would, and reports how long the commands took to reach
+// the wheels.
+#include "control.h"
+#include "histogram.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SEND_SLOTS 4096
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_stop(int sig) { stop_requested = 1; }
+
+static uint64_t monotonic_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void usage(const char *self) {
+  printf("usage: %s [--socket PATH] [--rate HZ] [--seconds S] [--ttl MS] "
+         "COMMAND\n"
+         "COMMAND: brake | forward | backward | left | right |\n"
+         "         velocity LINEAR ANGULAR (-1..1) | drive LEFT RIGHT "
+         "(-100..100)\n",
+         self);
+}
+
+static int parse_command(int argc, char **argv, int i, ControlCommand *cmd) {
+  static const char *words[] = {"brake", "forward", "backward", "left",
+                                "right"};
+  memset(cmd, 0, sizeof(*cmd));
+  cmd->version = CONTROL_VERSION;
+  for (int op = 0; op < 5; op++) {
+    if (!strcmp(argv[i], words[op])) {
+      cmd->op = op;
+      return i + 1 == argc ? 0 : -1;
+    }
+  }
+  if (i + 3 != argc) {
+    return -1;
+  }
+  if (!strcmp(argv[i], "velocity")) {
+    cmd->op = CONTROL_VELOCITY;
+    cmd->a = static_cast<int16_t>(atof(argv[i + 1]) * 1000);
+    cmd->b = static_cast<int16_t>(atof(argv[i + 2]) * 1000);
+    return 0;
+  }
+  if (!strcmp(argv[i], "drive")) {
+    cmd->op = CONTROL_DRIVE;
+    cmd->a = static_cast<int16_t>(atoi(argv[i + 1]));
+    cmd->b = static_cast<int16_t>(atoi(argv[i + 2]));
+    return 0;
+  }
+  return -1;
+}
+
+int main(int argc, char **argv) {
+  const char *path = getenv("TOY_CAR_SOCKET");
+  path = path ? path : CONTROL_SOCKET_PATH;
+  double rate = 100;
+  double seconds = 5;
+  int ttl = 0;
+  int i = 1;
+  for (; i < argc && !strncmp(argv[i], "--", 2); i++) {
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 1;
+    }
+    if (!strcmp(argv[i], "--socket")) {
+      path = argv[++i];
+    } else if (!strcmp(argv[i], "--rate")) {
+      rate = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--seconds")) {
+      seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--ttl")) {
+      ttl = atoi(argv[++i]);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  ControlCommand cmd;
+  if (i >= argc || parse_command(argc, argv, i, &cmd) || rate <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  cmd.ttl_ms = ttl;
+  signal(SIGINT, on_stop);
+  signal(SIGTERM, on_stop);
+
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  if (fd < 0 ||
+      connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr))) {
+    printf("failed to connect to %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  // send time of each seq still in flight, by seq % SEND_SLOTS
+  static uint64_t sent_at[SEND_SLOTS];
+  Histogram to_applied;
+  Histogram to_received;
+  uint64_t status_count[4] = {};
+  uint64_t sent = 0;
+  uint64_t period = static_cast<uint64_t>(1e9 / rate);
+  uint64_t end = monotonic_ns() + static_cast<uint64_t>(seconds * 1e9);
+  uint64_t next = monotonic_ns();
+  bool last = false;
+  while (true) {
+    uint64_t now = monotonic_ns();
+    if (!last && (stop_requested || now >= end)) {
+      // leave the car braked, not coasting until the ttl runs out
+      cmd.op = CONTROL_BRAKE;
+      last = true;
+      next = now;
+    }
+    if (now >= next) {
+      cmd.seq = ++sent;
+      sent_at[cmd.seq % SEND_SLOTS] = monotonic_ns();
+      if (send(fd, &cmd, sizeof(cmd), MSG_NOSIGNAL) != sizeof(cmd)) {
+        printf("car went away: %s\n", strerror(errno));
+        break;
+      }
+      next += period;
+      if (last) {
+        break;
+      }
+    }
+    ControlAck ack;
+    while (recv(fd, &ack, sizeof(ack), MSG_DONTWAIT) == sizeof(ack)) {
+      if (ack.status >= 0 && ack.status < 4) {
+        status_count[ack.status]++;
+      }
+      uint64_t t0 = sent_at[ack.seq % SEND_SLOTS];
+      if (ack.status == CONTROL_APPLIED && ack.applied_ns > t0) {
+        to_applied.add(ack.applied_ns - t0);
+      }
+      if (ack.received_ns > t0) {
+        to_received.add(ack.received_ns - t0);
+      }
+    }
+    now = monotonic_ns();
+    if (next > now) {
+      struct timespec wait;
+      wait.tv_sec = (next - now) / 1000000000ULL;
+      wait.tv_nsec = (next - now) % 1000000000ULL;
+      nanosleep(&wait, nullptr);
+    }
+  }
+  close(fd);
+
+  printf("sent %lu commands, acked: %lu applied, %lu superseded, %lu stale, "
+         "%lu invalid\n",
+         static_cast<unsigned long>(sent),
+         static_cast<unsigned long>(status_count[CONTROL_APPLIED]),
+         static_cast<unsigned long>(status_count[CONTROL_SUPERSEDED]),
+         static_cast<unsigned long>(status_count[CONTROL_STALE]),
+         static_cast<unsigned long>(status_count[CONTROL_INVALID]));
+  printf("send to received: p50 %.3fms p99 %.3fms max %.3fms\n",
+         to_received.percentile(50) / 1e6, to_received.percentile(99) / 1e6,
+         to_received.max() / 1e6);
+  printf("send to applied:  p50 %.3fms p99 %.3fms max %.3fms\n",
+         to_applied.percentile(50) / 1e6, to_applied.percentile(99) / 1e6,
+         to_applied.max() / 1e6);
+  return 0;
+}
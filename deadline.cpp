@@ -0,0 +1,67 @@
+#include "deadline.h"
+#include "perf_counters.h"
+#include "trace.h"
+#include <chrono>
+
+uint64_t monotonic_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+int Watchdog::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (running_) {
+    return 0;
+  }
+  running_ = true;
+  thread_ = std::thread(&Watchdog::run, this);
+  return 0;
+}
+
+void Watchdog::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) {
+      return;
+    }
+    running_ = false;
+  }
+  changed_.notify_one();
+  thread_.join();
+}
+
+void Watchdog::arm(uint64_t deadline) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    deadline_ = deadline;
+  }
+  changed_.notify_one();
+}
+
+uint64_t Watchdog::fired() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return fired_;
+}
+
+void Watchdog::run() {
+  trace_thread();
+  perf_thread("watchdog");
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_) {
+    // a tick is one wake up
+    perf_tick();
+    if (deadline_ == 0) {
+      changed_.wait(lock);
+      continue;
+    }
+    if (monotonic_ns() >= deadline_) {
+      deadline_ = 0;
+      fired_++;
+      on_expire_(arg_);
+      continue;
+    }
+    changed_.wait_until(lock, std::chrono::steady_clock::time_point(
+                                  std::chrono::nanoseconds(deadline_)));
+  }
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+
+// Monotonic ns. Command deadlines use this clock: lguTimestamp() jumps
+// when the wall clock is set.
+uint64_t monotonic_ns();
+
+// Calls on_expire from its own thread once the armed deadline has passed,
+// so a command runs out even while the loop is blocked in a read.
+// on_expire runs with the watchdog locked: once arm() returns, an old
+// deadline can no longer fire.
+class Watchdog {
+public:
+  typedef void (*Expire)(void *arg);
+  Watchdog(Expire on_expire, void *arg) : on_expire_(on_expire), arg_(arg) {}
+  ~Watchdog() { stop(); }
+  int start();
+  void stop();
+  // monotonic_ns() to fire at, 0 disarms. Replaces the last deadline.
+  void arm(uint64_t deadline);
+  uint64_t fired() const;
+
+private:
+  void run();
+
+private:
+  Expire on_expire_;
+  void *arg_;
+  mutable std::mutex mutex_;
+  std::condition_variable changed_;
+  std::thread thread_;
+  uint64_t deadline_{0};
+  uint64_t fired_{0};
+  bool running_{false};
+};
@@ -0,0 +1,172 @@
+#include "dispatch.h"
+#include "phase.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+extern "C" {
+#include "lgpio.h"
+}
+
+void select_command(const CommandSources &from, Car *car, TickCommand *out) {
+  out->source = "joystick";
+  {
+    PhaseScope scan(PHASE_SCAN);
+    out->cmd = from.joystick->scan_cmd();
+    out->stamp = from.joystick->cmd_stamp();
+    out->deadline = from.joystick->cmd_deadline();
+  }
+  // a live command from the host stands in for the pad, special words
+  // included
+  Commander *primary = from.joystick;
+  {
+    PhaseScope scan(PHASE_SCAN);
+    std::string hosted = from.ring->scan_cmd();
+    if (!hosted.empty()) {
+      out->cmd = hosted;
+      out->stamp = from.ring->cmd_stamp();
+      out->deadline = from.ring->cmd_deadline();
+      primary = from.ring;
+      out->source = "host";
+    }
+  }
+  std::string net;
+  {
+    PhaseScope scan(PHASE_SCAN);
+    net = from.socket->scan_cmd();
+  }
+  if (!net.empty() && net != "idle") {
+    // a live planner command goes first
+    out->cmd = net;
+    out->stamp = 0;
+    out->deadline = from.socket->cmd_deadline();
+    out->source = "socket";
+    PhaseScope decide(PHASE_DECIDE);
+    car->set_engine(90, 40, 40);
+    int32_t left = 0, right = 0;
+    if (from.socket->drive_hint(&left, &right)) {
+      car->set_drive(left, right);
+    }
+  } else if (out->cmd == "fallback" && !net.empty()) {
+    // the terminal read would block the socket, with a planner
+    // connected the car waits braked for its next command
+    out->cmd = "brake";
+    out->source = "socket";
+  } else if (out->cmd == "auto_sonar") {
+    out->cmd = from.sonar->scan_cmd();
+    out->stamp = from.sonar->cmd_stamp();
+    // the auto button is held down, the pad stays quiet
+    out->deadline = from.sonar->cmd_deadline();
+    out->source = "sonar";
+    PhaseScope decide(PHASE_DECIDE);
+    uint32_t f_speed = 20, b_speed = 20, t_speed = 70;
+    from.sonar->engine_hint(&f_speed, &b_speed, &t_speed);
+    car->set_engine(f_speed, b_speed, t_speed);
+    PhaseScope log(PHASE_LOG);
+    std::cout << "using sonar cmd:" << out->cmd << std::endl;
+  } else if (out->cmd == "fallback") {
+    {
+      PhaseScope scan(PHASE_SCAN);
+      out->cmd = from.terminal->scan_cmd();
+      out->stamp = from.terminal->cmd_stamp();
+      out->deadline = from.terminal->cmd_deadline();
+    }
+    out->source = "terminal";
+    PhaseScope decide(PHASE_DECIDE);
+    car->set_engine(90, 40, 40);
+    PhaseScope log(PHASE_LOG);
+    std::cout << "using fallback terminal cmd:" << out->cmd << std::endl;
+  } else {
+    PhaseScope decide(PHASE_DECIDE);
+    uint32_t f_speed = 90, b_speed = 40, t_speed = 40;
+    primary->engine_hint(&f_speed, &b_speed, &t_speed);
+    car->set_engine(f_speed, b_speed, t_speed);
+    int32_t left = 0, right = 0;
+    if (primary->drive_hint(&left, &right)) {
+      car->set_drive(left, right);
+    }
+  }
+}
+
+ControlLoop::ControlLoop(const CommandSources &from, Car *car,
+                         Watchdog *watchdog, uint64_t period_ns)
+    : from_(from), car_(car), watchdog_(watchdog), period_ns_(period_ns) {
+  next_tick_ = monotonic_ns() + period_ns_;
+}
+
+void ControlLoop::publish_to(CarStatePage *page,
+                             TelemetrySender *telemetry) {
+  page_ = page;
+  telemetry_ = telemetry;
+}
+
+void ControlLoop::tick() {
+  tick_++;
+  // 保持一定的控制周期, a command on the control socket runs at once
+  // instead of waiting for the next tick
+  bool timed = true;
+  uint64_t now = monotonic_ns();
+  if (now < next_tick_) {
+    struct pollfd pfd = {from_.socket->poll_fd(), POLLIN, 0};
+    struct timespec wait;
+    wait.tv_sec = (next_tick_ - now) / 1000000000ULL;
+    wait.tv_nsec = (next_tick_ - now) % 1000000000ULL;
+    timed = ppoll(&pfd, 1, &wait, nullptr) == 0;
+  }
+  if (timed) {
+    // a loop that overran starts a new period instead of catching up
+    next_tick_ = std::max<uint64_t>(next_tick_ + period_ns_, monotonic_ns());
+  }
+  TRACE_SPAN("tick");
+  uint64_t tick_start = monotonic_ns();
+
+  // 命令输入提示
+  if (timed) {
+    PhaseScope log(PHASE_LOG);
+    std::cout << std::endl << std::endl;
+    std::cout << "...........等待输入指令left(l)/right(r)/forward(f)/"
+                 "backward(b)/brake(*)....."
+              << std::endl;
+  }
+  select_command(from_, car_, &picked_);
+
+  bool refused = picked_.deadline && monotonic_ns() >= picked_.deadline;
+  if (refused) {
+    stale_++;
+    PhaseScope log(PHASE_LOG);
+    std::cout << "stale command " << picked_.cmd << ", braking" << std::endl;
+    picked_.cmd = "brake";
+    picked_.deadline = 0;
+  }
+  // the old deadline cannot fire once the new one is armed
+  watchdog_->arm(picked_.deadline);
+  car_->execute(picked_.cmd, picked_.stamp);
+  if (!strcmp(picked_.source, "socket")) {
+    from_.socket->applied(monotonic_ns(), refused);
+  }
+
+  now = monotonic_ns();
+  bool send_telemetry = telemetry_ && telemetry_->due(now);
+  if (page_ || send_telemetry) {
+    CarState state;
+    car_state_clear(&state);
+    state.stamp = lguTimestamp();
+    state.tick = tick_;
+    snprintf(state.cmd, sizeof(state.cmd), "%s", picked_.cmd.c_str());
+    snprintf(state.source, sizeof(state.source), "%s", picked_.source);
+    car_->fill_state(&state);
+    from_.sonar->fill_state(&state);
+    state.loop_ns = now - tick_start;
+    loop_max_ns_ = std::max(loop_max_ns_, state.loop_ns);
+    state.loop_max_ns = loop_max_ns_;
+    state.stale = stale_;
+    if (page_) {
+      car_state_publish(page_, state);
+    }
+    if (send_telemetry) {
+      telemetry_->send(state, now);
+    }
+  }
+}
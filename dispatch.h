@@ -0,0 +1,65 @@
+#pragma once
+#include "car.h"
+#include "car_state.h"
+#include "commander.h"
+#include "deadline.h"
+#include "telemetry.h"
+#include <stdint.h>
+#include <string>
+
+// The commanders the control loop reads, none of them may be null.
+struct CommandSources {
+  Commander *joystick;
+  Commander *sonar;
+  Commander *terminal;
+  // commanders run by toy_car_host in a process of their own
+  Commander *ring;
+  // external planners, see control.h and toy_car_ctl
+  Commander *socket;
+};
+
+// The command one loop tick runs.
+struct TickCommand {
+  std::string cmd;
+  // as Commander::cmd_stamp() and cmd_deadline()
+  uint64_t stamp;
+  uint64_t deadline;
+  const char *source;
+};
+
+// Reads the commanders, picks the command of this tick and sets the car's
+// engine and drive duties for it. Only reads the terminal, which blocks,
+// when nothing else has a command.
+void select_command(const CommandSources &from, Car *car, TickCommand *out);
+
+// main()'s control loop, one tick per call: waits out the rest of the
+// period (a command on the control socket cuts the wait short), runs the
+// command select_command() picks with its deadline on the watchdog, and
+// publishes the car's state. toy_car_sim runs the same ticks with a short
+// period.
+class ControlLoop {
+public:
+  ControlLoop(const CommandSources &from, Car *car, Watchdog *watchdog,
+              uint64_t period_ns);
+  ~ControlLoop() {}
+  // Where tick() publishes the car's state, either may be null.
+  void publish_to(CarStatePage *page, TelemetrySender *telemetry);
+  void tick();
+  // ticks run so far
+  uint64_t ticks() const { return tick_; }
+  // commands refused for being past their deadline
+  uint64_t stale() const { return stale_; }
+
+private:
+  CommandSources from_;
+  Car *car_;
+  Watchdog *watchdog_;
+  uint64_t period_ns_;
+  CarStatePage *page_{nullptr};
+  TelemetrySender *telemetry_{nullptr};
+  TickCommand picked_;
+  uint64_t next_tick_;
+  uint64_t tick_{0};
+  uint64_t stale_{0};
+  uint64_t loop_max_ns_{0};
+};
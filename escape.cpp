@@ -0,0 +1,108 @@
+#include "escape.h"
+#include <algorithm>
+#include <cmath>
+
+static const double BIN_DEG = 360.0 / EscapePlanner::BINS;
+
+void EscapePlanner::reset() {
+  for (uint32_t i = 0; i < BINS; i++) {
+    profile_[i] = 0;
+    seen_[i] = false;
+  }
+}
+
+void EscapePlanner::add_sample(double heading_deg, double distance) {
+  double h = std::fmod(heading_deg, 360.0);
+  if (h < 0) {
+    h += 360.0;
+  }
+  uint32_t bin = static_cast<uint32_t>(h / BIN_DEG) % BINS;
+  // 同一扇区取最近的读数，宁可保守
+  if (!seen_[bin] || distance < profile_[bin]) {
+    profile_[bin] = distance;
+  }
+  seen_[bin] = true;
+}
+
+void EscapePlanner::fill_gaps(double *profile) {
+  // the car may turn more than one bin between two pings, an unseen bin
+  // takes the closer one of its nearest seen neighbours
+  for (uint32_t i = 0; i < BINS; i++) {
+    profile[i] = profile_[i];
+    if (seen_[i]) {
+      continue;
+    }
+    double best = 0;
+    bool found = false;
+    for (uint32_t k = 1; k < BINS; k++) {
+      uint32_t l = (i + BINS - k) % BINS;
+      uint32_t r = (i + k) % BINS;
+      if (seen_[l] || seen_[r]) {
+        if (seen_[l] && seen_[r]) {
+          best = std::min(profile_[l], profile_[r]);
+        } else {
+          best = seen_[l] ? profile_[l] : profile_[r];
+        }
+        found = true;
+        break;
+      }
+    }
+    profile[i] = found ? best : 0;
+  }
+}
+
+bool EscapePlanner::select(double safe_distance, double *target_deg,
+                           double *width_deg) {
+  double profile[BINS];
+  fill_gaps(profile);
+
+  uint32_t blocked = BINS;
+  uint32_t farthest = 0;
+  for (uint32_t i = 0; i < BINS; i++) {
+    if (profile[i] <= safe_distance) {
+      blocked = i;
+    }
+    if (profile[i] > profile[farthest]) {
+      farthest = i;
+    }
+  }
+  if (profile[farthest] <= safe_distance) {
+    return false;
+  }
+  if (blocked == BINS) {
+    // 四周都空旷，直接朝最远的方向走
+    *target_deg = (farthest + 0.5) * BIN_DEG;
+    *width_deg = 360.0;
+    return true;
+  }
+
+  // walk once around the circle starting right after a blocked bin so that
+  // a free run wrapping through 0 degrees is seen as one run
+  uint32_t best_start = 0;
+  uint32_t best_len = 0;
+  double best_sum = 0;
+  uint32_t run_start = 0;
+  uint32_t run_len = 0;
+  double run_sum = 0;
+  for (uint32_t k = 1; k <= BINS; k++) {
+    uint32_t i = (blocked + k) % BINS;
+    if (profile[i] > safe_distance) {
+      if (run_len == 0) {
+        run_start = i;
+        run_sum = 0;
+      }
+      run_len++;
+      run_sum += profile[i];
+      if (run_len > best_len || (run_len == best_len && run_sum > best_sum)) {
+        best_start = run_start;
+        best_len = run_len;
+        best_sum = run_sum;
+      }
+    } else {
+      run_len = 0;
+    }
+  }
+  *target_deg = std::fmod((best_start + best_len / 2.0) * BIN_DEG, 360.0);
+  *width_deg = best_len * BIN_DEG;
+  return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+
+// Angular distance profile collected while the car spins in place. Headings
+// are measured in degrees clockwise from where the sweep started.
+class EscapePlanner {
+public:
+  static const uint32_t BINS = 24; /*15 degrees per bin*/
+
+  EscapePlanner() { reset(); }
+  ~EscapePlanner() {}
+  void reset();
+  void add_sample(double heading_deg, double distance);
+  // Picks the centre of the widest run of bins farther than safe_distance.
+  // Returns false if no bin is free.
+  bool select(double safe_distance, double *target_deg, double *width_deg);
+
+private:
+  void fill_gaps(double *profile);
+
+private:
+  double profile_[BINS];
+  bool seen_[BINS];
+};
@@ -0,0 +1,177 @@
+#include "gamepad.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#define LONG_BITS (8 * sizeof(unsigned long))
+#define BIT_LONGS(n) (((n) + LONG_BITS - 1) / LONG_BITS)
+
+static bool test_bit(const unsigned long *bits, int n) {
+  return bits[n / LONG_BITS] >> (n % LONG_BITS) & 1;
+}
+
+int Gamepad::open(const char *path) {
+  close();
+  if (path && path[0]) {
+    return probe(path);
+  }
+  char dev[32];
+  for (int i = 0; i < 32; i++) {
+    snprintf(dev, sizeof(dev), "/dev/input/event%d", i);
+    if (probe(dev) == 0) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+void Gamepad::close() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+int Gamepad::probe(const char *path) {
+  int fd = ::open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  unsigned long ev[BIT_LONGS(EV_CNT)] = {};
+  unsigned long abs[BIT_LONGS(ABS_CNT)] = {};
+  unsigned long key[BIT_LONGS(KEY_CNT)] = {};
+  if (ioctl(fd, EVIOCGBIT(0, sizeof(ev)), ev) < 0 ||
+      !test_bit(ev, EV_ABS) || !test_bit(ev, EV_KEY) ||
+      ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs)), abs) < 0 ||
+      ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(key)), key) < 0 ||
+      !(test_bit(key, BTN_JOYSTICK) || test_bit(key, BTN_GAMEPAD))) {
+    ::close(fd);
+    return -1;
+  }
+
+  // the numbering joydev gives the same device: axes in code order,
+  // buttons from BTN_JOYSTICK up, then the ones below it
+  axis_count_ = 0;
+  for (int code = 0; code < ABS_CNT && axis_count_ < GAMEPAD_MAX_AXES;
+       code++) {
+    if (!test_bit(abs, code)) {
+      continue;
+    }
+    struct input_absinfo info;
+    if (ioctl(fd, EVIOCGABS(code), &info) < 0) {
+      continue;
+    }
+    axis_code_[axis_count_] = code;
+    min_[axis_count_] = info.minimum;
+    max_[axis_count_] = info.maximum;
+    flat_[axis_count_] = info.flat;
+    axis_count_++;
+  }
+  button_count_ = 0;
+  for (int i = 0; i < KEY_CNT - BTN_MISC; i++) {
+    int code = BTN_MISC + (BTN_JOYSTICK - BTN_MISC + i) % (KEY_CNT - BTN_MISC);
+    if (test_bit(key, code) && button_count_ < GAMEPAD_MAX_BUTTONS) {
+      button_code_[button_count_++] = code;
+    }
+  }
+  if (ioctl(fd, EVIOCGNAME(sizeof(name_)), name_) < 0) {
+    snprintf(name_, sizeof(name_), "%s", path);
+  }
+  fd_ = fd;
+  resync();
+  return 0;
+}
+
+int Gamepad::scale(int n, int value) const {
+  int64_t center = (static_cast<int64_t>(min_[n]) + max_[n]) / 2;
+  int64_t half = (static_cast<int64_t>(max_[n]) - min_[n]) / 2 - flat_[n];
+  int64_t off = value - center;
+  if (half <= 0 || (off <= flat_[n] && off >= -flat_[n])) {
+    return 0;
+  }
+  off += off > 0 ? -flat_[n] : flat_[n];
+  int64_t out = off * 32767 / half;
+  return out > 32767 ? 32767 : out < -32767 ? -32767 : out;
+}
+
+void Gamepad::resync() {
+  for (int n = 0; n < axis_count_; n++) {
+    struct input_absinfo info;
+    if (ioctl(fd_, EVIOCGABS(axis_code_[n]), &info) == 0) {
+      axis_[n] = scale(n, info.value);
+    }
+  }
+  unsigned long key[BIT_LONGS(KEY_CNT)] = {};
+  if (ioctl(fd_, EVIOCGKEY(sizeof(key)), key) == 0) {
+    for (int n = 0; n < button_count_; n++) {
+      button_[n] = test_bit(key, button_code_[n]);
+    }
+  }
+  memcpy(next_axis_, axis_, sizeof(axis_));
+  memcpy(next_button_, button_, sizeof(button_));
+}
+
+int Gamepad::poll(uint64_t *first_stamp) {
+  int frames = 0;
+  struct input_event buf[64];
+  while (fd_ >= 0) {
+    ssize_t bytes = read(fd_, buf, sizeof(buf));
+    if (bytes < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes < 0 && errno == EAGAIN) {
+      break;
+    }
+    if (bytes <= 0) {
+      // unplugged
+      close();
+      break;
+    }
+    int count = bytes / sizeof(buf[0]);
+    for (int i = 0; i < count; i++) {
+      const struct input_event &e = buf[i];
+      if (e.type == EV_SYN && e.code == SYN_DROPPED) {
+        // the rest of this frame is lost, read the state at its end
+        dropped_ = true;
+      } else if (e.type == EV_SYN && e.code == SYN_REPORT) {
+        if (dropped_) {
+          resync();
+          dropped_ = false;
+        } else {
+          memcpy(axis_, next_axis_, sizeof(axis_));
+          memcpy(button_, next_button_, sizeof(button_));
+        }
+        if (frames++ == 0) {
+          // CLOCK_REALTIME unless someone set EVIOCSCLOCKID, the same
+          // clock as lguTimestamp()
+          *first_stamp = e.input_event_sec * 1000000000ULL +
+                         e.input_event_usec * 1000ULL;
+        }
+      } else if (dropped_) {
+        continue;
+      } else if (e.type == EV_ABS) {
+        for (int n = 0; n < axis_count_; n++) {
+          if (axis_code_[n] == e.code) {
+            next_axis_[n] = scale(n, e.value);
+            break;
+          }
+        }
+      } else if (e.type == EV_KEY) {
+        for (int n = 0; n < button_count_; n++) {
+          if (button_code_[n] == e.code) {
+            next_button_[n] = e.value != 0;
+            break;
+          }
+        }
+      }
+    }
+    if (count < 64) {
+      break;
+    }
+  }
+  return frames;
+}
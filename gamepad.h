@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+
+#define GAMEPAD_MAX_AXES 16
+#define GAMEPAD_MAX_BUTTONS 32
+
+// A gamepad read through evdev (/dev/input/event*). Axes and buttons are
+// numbered the way the js interface numbers them and axis values scaled to
+// its -32767..32767, so code written against /dev/input/js0 keeps working.
+// Changes are applied a SYN_REPORT frame at a time: both sticks always come
+// from the same frame.
+class Gamepad {
+public:
+  Gamepad() {}
+  ~Gamepad() { close(); }
+  // A null or empty path takes the first event device with gamepad or
+  // joystick buttons and absolute axes. Returns -1 if there is none.
+  int open(const char *path);
+  void close();
+  bool is_open() const { return fd_ >= 0; }
+  const char *name() const { return name_; }
+  // Reads everything queued. Returns the number of frames completed and
+  // the time of the first in *first_stamp, in lguTimestamp() ns.
+  int poll(uint64_t *first_stamp);
+  int axis(int n) const { return n < GAMEPAD_MAX_AXES ? axis_[n] : 0; }
+  bool button(int n) const {
+    return n < GAMEPAD_MAX_BUTTONS && button_[n];
+  }
+
+private:
+  int probe(const char *path);
+  int scale(int n, int value) const;
+  // reads the whole state, after the kernel dropped events
+  void resync();
+
+private:
+  int fd_{-1};
+  char name_[64]{};
+  int axis_count_{0};
+  int button_count_{0};
+  // evdev code of each js axis and button
+  uint16_t axis_code_[GAMEPAD_MAX_AXES]{};
+  uint16_t button_code_[GAMEPAD_MAX_BUTTONS]{};
+  int32_t min_[GAMEPAD_MAX_AXES]{};
+  int32_t max_[GAMEPAD_MAX_AXES]{};
+  int32_t flat_[GAMEPAD_MAX_AXES]{};
+  // state after the last frame, and the frame being read
+  int axis_[GAMEPAD_MAX_AXES]{};
+  bool button_[GAMEPAD_MAX_BUTTONS]{};
+  int next_axis_[GAMEPAD_MAX_AXES]{};
+  bool next_button_[GAMEPAD_MAX_BUTTONS]{};
+  bool dropped_{false};
+};
@@ -0,0 +1,255 @@
+// GPIO throughput and latency of whichever backend it is linked with:
+// liblgpio on the real chip, the RP1 registers or the simulation. Prints
+// one JSON object per result, so runs can be compared across kernel and
+// library versions.
+#include "histogram.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/utsname.h>
+#include <thread>
+extern "C" {
+#include "lgpio.h"
+// set by the stand-in backends, liblgpio has none
+extern const char *const toy_gpio_backend_name __attribute__((weak));
+}
+#pragma weak lguVersion
+
+// The simulated build binds a simulation to the calling thread here.
+int gpio_bench_setup() __attribute__((weak));
+
+// as wired in gpio_table.txt
+static const int motor_pins[8] = {17, 27, 23, 24, 5, 6, 20, 21};
+static const int ir_pins[4] = {25, 8, 7, 1};
+
+static char meta[256];
+static volatile int sink;
+
+static uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static void emit(const char *test, int pins, uint64_t ops, uint64_t ns,
+                 const Histogram &latency) {
+  double per_op = ops ? static_cast<double>(ns) / ops : 0;
+  double per_sec = ns ? ops * 1e9 / ns : 0;
+  printf("{%s,\"test\":\"%s\",\"pins\":%d,\"ops\":%lu,\"ns_per_op\":%.1f,"
+         "\"ops_per_sec\":%.0f,\"pins_per_sec\":%.0f,\"p50_ns\":%lu,"
+         "\"p99_ns\":%lu,\"max_ns\":%lu}\n",
+         meta, test, pins, static_cast<unsigned long>(ops), per_op, per_sec,
+         per_sec * pins, static_cast<unsigned long>(latency.percentile(50)),
+         static_cast<unsigned long>(latency.percentile(99)),
+         static_cast<unsigned long>(latency.max()));
+}
+
+static void emit_status(const char *test, const char *status,
+                        const char *reason, int rc) {
+  printf("{%s,\"test\":\"%s\",\"status\":\"%s\",\"reason\":\"%s\","
+         "\"rc\":%d}\n",
+         meta, test, status, reason, rc);
+}
+
+// Times op(i) once in bulk for throughput and once per call for the
+// latency percentiles.
+template <typename F>
+static void run(const char *test, int pins, uint64_t ops, F op) {
+  uint64_t begin = now_ns();
+  for (uint64_t i = 0; i < ops; i++) {
+    op(i);
+  }
+  uint64_t total = now_ns() - begin;
+  Histogram latency;
+  for (uint64_t i = 0; i < ops; i++) {
+    uint64_t t0 = now_ns();
+    op(i);
+    latency.add(now_ns() - t0);
+  }
+  emit(test, pins, ops, total, latency);
+}
+
+static std::atomic<uint64_t> alert_at{0};
+
+static void on_alert(int num_alerts, lgGpioAlert_p alerts, void *userdata) {
+  alert_at = now_ns();
+}
+
+static void bench_writes(int h, uint64_t ops) {
+  // both inputs of an AT8236 channel at the same level only brakes or
+  // coasts, the group writes never drive a wheel
+  int levels[8] = {1, 1, 1, 1, 1, 1, 1, 1};
+  for (int i = 0; i < 8; i++) {
+    int rc = lgGpioClaimOutput(h, 0, motor_pins[i], 1);
+    if (rc) {
+      emit_status("write_single", "failed", "claim", rc);
+      return;
+    }
+  }
+  run("write_single", 1, ops, [h](uint64_t i) {
+    lgGpioWrite(h, motor_pins[i % 8], (i / 8) & 1);
+  });
+  run("toggle", 1, ops, [h](uint64_t) {
+    lgGpioWrite(h, motor_pins[0], 0);
+    lgGpioWrite(h, motor_pins[0], 1);
+  });
+  for (int i = 0; i < 8; i++) {
+    lgGpioFree(h, motor_pins[i]);
+  }
+
+  int rc = lgGroupClaimOutput(h, 0, 8, motor_pins, levels);
+  if (rc) {
+    emit_status("write_group", "failed", "claim", rc);
+    return;
+  }
+  run("write_group", 8, ops, [h](uint64_t i) {
+    lgGroupWrite(h, motor_pins[0], i & 1 ? 0xff : 0, 0xff);
+  });
+  lgGroupWrite(h, motor_pins[0], 0xff, 0xff);
+  lgGroupFree(h, motor_pins[0]);
+}
+
+static void bench_reads(int h, uint64_t ops) {
+  for (int i = 0; i < 4; i++) {
+    int rc = lgGpioClaimInput(h, LG_SET_PULL_UP, ir_pins[i]);
+    if (rc) {
+      emit_status("read_single", "failed", "claim", rc);
+      return;
+    }
+  }
+  run("read_single", 1, ops,
+      [h](uint64_t i) { sink = lgGpioRead(h, ir_pins[i % 4]); });
+  for (int i = 0; i < 4; i++) {
+    lgGpioFree(h, ir_pins[i]);
+  }
+
+  int rc = lgGroupClaimInput(h, LG_SET_PULL_UP, 4, ir_pins);
+  if (rc) {
+    emit_status("read_group", "failed", "claim", rc);
+    return;
+  }
+  run("read_group", 4, ops, [h](uint64_t) {
+    uint64_t bits;
+    sink = lgGroupRead(h, ir_pins[0], &bits);
+  });
+  lgGroupFree(h, ir_pins[0]);
+}
+
+// Needs out wired to in. Write to read-back and write to alert callback.
+static void bench_loopback(int h, int out, int in, uint64_t ops) {
+  int rc = lgGpioClaimOutput(h, 0, out, 0);
+  if (!rc) {
+    rc = lgGpioClaimInput(h, LG_SET_PULL_NONE, in);
+  }
+  if (rc) {
+    emit_status("readback", "failed", "claim", rc);
+    return;
+  }
+  Histogram latency;
+  uint64_t total = 0;
+  uint64_t timeouts = 0;
+  for (uint64_t i = 0; i < ops; i++) {
+    int level = (i + 1) & 1;
+    uint64_t t0 = now_ns();
+    lgGpioWrite(h, out, level);
+    uint64_t t1 = t0;
+    while (lgGpioRead(h, in) != level && (t1 = now_ns()) - t0 < 1000000) {
+    }
+    t1 = now_ns();
+    if (t1 - t0 >= 1000000) {
+      timeouts++;
+      continue;
+    }
+    latency.add(t1 - t0);
+    total += t1 - t0;
+  }
+  if (timeouts == ops) {
+    emit_status("readback", "failed", "level never came back, check wiring",
+                0);
+  } else {
+    emit("readback", 1, latency.count(), total, latency);
+  }
+  lgGpioFree(h, in);
+
+  rc = lgGpioClaimAlert(h, 0, LG_BOTH_EDGES, in, -1);
+  if (!rc) {
+    rc = lgGpioSetAlertsFunc(h, in, on_alert, nullptr);
+  }
+  if (rc) {
+    emit_status("alert", "unsupported", "claim alert", rc);
+    lgGpioFree(h, out);
+    return;
+  }
+  latency.reset();
+  total = 0;
+  // alerts go through a thread, keep to a rate it can follow
+  uint64_t count = std::min<uint64_t>(ops, 2000);
+  for (uint64_t i = 0; i < count; i++) {
+    alert_at = 0;
+    uint64_t t0 = now_ns();
+    lgGpioWrite(h, out, (i + 1) & 1);
+    while (alert_at == 0 && now_ns() - t0 < 100000000) {
+      std::this_thread::yield();
+    }
+    if (alert_at != 0) {
+      latency.add(alert_at - t0);
+      total += alert_at - t0;
+    }
+  }
+  emit("alert", 1, latency.count(), total, latency);
+  lgGpioFree(h, in);
+  lgGpioFree(h, out);
+}
+
+int main(int argc, char **argv) {
+  uint64_t ops = 100000;
+  int out = -1;
+  int in = -1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--ops") && i + 1 < argc) {
+      ops = strtoull(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "--loopback") && i + 2 < argc) {
+      out = atoi(argv[++i]);
+      in = atoi(argv[++i]);
+    } else {
+      printf("usage: %s [--ops N] [--loopback OUT_GPIO IN_GPIO]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  struct utsname u;
+  uname(&u);
+  char version[16] = "null";
+  if (lguVersion) {
+    snprintf(version, sizeof(version), "\"0x%08x\"", lguVersion());
+  }
+  snprintf(meta, sizeof(meta),
+           "\"backend\":\"%s\",\"kernel\":\"%s\",\"machine\":\"%s\","
+           "\"lgpio\":%s",
+           &toy_gpio_backend_name ? toy_gpio_backend_name : "lgpio",
+           u.release, u.machine, version);
+  if (gpio_bench_setup && gpio_bench_setup()) {
+    fprintf(stderr, "failed to set up the backend\n");
+    return 1;
+  }
+  fprintf(stderr, "toggles the motor driver pins, lift the wheels first\n");
+  int h = lgGpiochipOpen(4);
+  if (h < 0) {
+    emit_status("open", "failed", "gpiochip", h);
+    return 1;
+  }
+  // the per-call percentiles include this much of the clock itself
+  run("clock", 0, ops, [](uint64_t) {});
+  bench_writes(h, ops);
+  bench_reads(h, ops);
+  if (out >= 0) {
+    bench_loopback(h, out, in, ops);
+  } else {
+    emit_status("alert", "skipped", "needs --loopback OUT IN", 0);
+  }
+  lgGpiochipClose(h);
+  return 0;
+}
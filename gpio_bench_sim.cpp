@@ -0,0 +1,11 @@
+// Runs toy_car_gpio_bench against the simulation: an empty room bound to
+// the bench thread.
+#include "sim.h"
+
+int gpio_bench_setup() {
+  static SimWorld world;
+  world.build_index();
+  static Simulation sim(world);
+  sim.bind();
+  return 0;
+}
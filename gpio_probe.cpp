@@ -0,0 +1,281 @@
+#include "gpio_probe.h"
+#include "histogram.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+extern "C" {
+#include "lgpio.h"
+}
+
+enum GpioCall {
+  CALL_CHIP_OPEN = 0,
+  CALL_CHIP_CLOSE,
+  CALL_CLAIM_INPUT,
+  CALL_CLAIM_OUTPUT,
+  CALL_FREE,
+  CALL_READ,
+  CALL_WRITE,
+  CALL_TX_PWM,
+  CALL_TX_SERVO,
+  CALL_GROUP_CLAIM_INPUT,
+  CALL_GROUP_CLAIM_OUTPUT,
+  CALL_GROUP_FREE,
+  CALL_GROUP_READ,
+  CALL_GROUP_WRITE,
+  CALL_CLAIM_ALERT,
+  CALL_SET_ALERTS_FUNC,
+  CALL_COUNT,
+};
+
+static const char *call_names[CALL_COUNT] = {
+    "lgGpiochipOpen",   "lgGpiochipClose", "lgGpioClaimInput",
+    "lgGpioClaimOutput", "lgGpioFree",      "lgGpioRead",
+    "lgGpioWrite",      "lgTxPwm",         "lgTxServo",
+    "lgGroupClaimInput", "lgGroupClaimOutput", "lgGroupFree",
+    "lgGroupRead",      "lgGroupWrite",    "lgGpioClaimAlert",
+    "lgGpioSetAlertsFunc"};
+
+// pins 0..63, chip calls go to the last slot. Group calls go by the
+// group's first pin.
+#define PROBE_PINS 65
+// function, pin and thread triples the car uses, with room to spare. Calls
+// past these are only counted.
+#define PROBE_SLOTS 128
+
+// Only the owning thread writes a slot, so recording takes no lock. Each
+// function and pin keeps a list of the slots of the threads that called
+// it.
+struct ProbeSlot {
+  const void *owner{nullptr};
+  ProbeSlot *next{nullptr};
+  Histogram latency;
+  uint64_t errors{0};
+};
+
+static const bool probe_on = [] {
+  const char *env = getenv("TOY_CAR_GPIO_PROBE");
+  return env && strcmp(env, "0") != 0;
+}();
+static std::atomic<ProbeSlot *> slots[CALL_COUNT][PROBE_PINS];
+// allocated before main() when the probe is on, a first call of a thread
+// on a pin takes the next one instead of going to the heap
+static ProbeSlot *const pool = probe_on ? new ProbeSlot[PROBE_SLOTS] : nullptr;
+static std::atomic<uint32_t> pool_used{0};
+static std::atomic<uint64_t> untimed{0};
+// its address tells the threads apart
+static thread_local char probe_self;
+
+static inline uint64_t probe_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void probe_record(GpioCall call, int gpio, uint64_t begin, int rc) {
+  uint64_t ns = probe_now() - begin;
+  int pin = gpio >= 0 && gpio < PROBE_PINS - 1 ? gpio : PROBE_PINS - 1;
+  std::atomic<ProbeSlot *> &head = slots[call][pin];
+  ProbeSlot *slot = head.load(std::memory_order_acquire);
+  while (slot && slot->owner != &probe_self) {
+    slot = slot->next;
+  }
+  if (!slot) {
+    // first call of this thread for this function and pin
+    uint32_t next = pool_used.fetch_add(1, std::memory_order_relaxed);
+    if (next >= PROBE_SLOTS) {
+      untimed.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    slot = &pool[next];
+    slot->owner = &probe_self;
+    slot->next = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(slot->next, slot,
+                                       std::memory_order_release,
+                                       std::memory_order_relaxed)) {
+    }
+  }
+  slot->latency.add(ns);
+  slot->errors += rc < 0 ? 1 : 0;
+}
+
+static void print_slots(const char *call, const char *pin,
+                        const ProbeSlot *slot) {
+  Histogram h;
+  uint64_t errors = 0;
+  for (; slot; slot = slot->next) {
+    h.merge(slot->latency);
+    errors += slot->errors;
+  }
+  if (!h.count()) {
+    return;
+  }
+  printf("%-19s %4s %10lu %7lu %9lu %9lu %9lu %9lu %9lu\n", call, pin,
+         static_cast<unsigned long>(h.count()),
+         static_cast<unsigned long>(errors),
+         static_cast<unsigned long>(h.sum() / h.count()),
+         static_cast<unsigned long>(h.percentile(50)),
+         static_cast<unsigned long>(h.percentile(90)),
+         static_cast<unsigned long>(h.percentile(99)),
+         static_cast<unsigned long>(h.max()));
+}
+
+void gpio_probe_report() {
+  if (!probe_on) {
+    return;
+  }
+  printf("gpio call latency in ns\n");
+  printf("%-19s %4s %10s %7s %9s %9s %9s %9s %9s\n", "call", "pin", "calls",
+         "errors", "mean", "p50", "p90", "p99", "max");
+  for (int c = 0; c < CALL_COUNT; c++) {
+    for (int p = 0; p < PROBE_PINS; p++) {
+      char pin[8];
+      snprintf(pin, sizeof(pin), "%d", p);
+      print_slots(call_names[c], p == PROBE_PINS - 1 ? "-" : pin,
+                  slots[c][p].load(std::memory_order_acquire));
+    }
+  }
+  if (untimed.load()) {
+    printf("%lu calls past the first %d function, pin and thread triples "
+           "were not timed\n",
+           static_cast<unsigned long>(untimed.load()), PROBE_SLOTS);
+  }
+}
+
+template <typename F>
+static inline int probe(GpioCall call, int gpio, F real) {
+  if (!probe_on) {
+    return real();
+  }
+  uint64_t begin = probe_now();
+  int rc = real();
+  probe_record(call, gpio, begin, rc);
+  return rc;
+}
+
+extern "C" {
+
+int __real_lgGpiochipOpen(int gpioDev);
+int __real_lgGpiochipClose(int handle);
+int __real_lgGpioClaimInput(int handle, int lFlags, int gpio);
+int __real_lgGpioClaimOutput(int handle, int lFlags, int gpio, int level);
+int __real_lgGpioFree(int handle, int gpio);
+int __real_lgGpioRead(int handle, int gpio);
+int __real_lgGpioWrite(int handle, int gpio, int level);
+int __real_lgTxPwm(int handle, int gpio, float pwmFrequency,
+                   float pwmDutyCycle, int pwmOffset, int pwmCycles);
+int __real_lgTxServo(int handle, int gpio, int pulseWidth, int servoFrequency,
+                     int servoOffset, int servoCycles);
+int __real_lgGroupClaimInput(int handle, int lFlags, int count,
+                             const int *gpios);
+int __real_lgGroupClaimOutput(int handle, int lFlags, int count,
+                              const int *gpios, const int *levels);
+int __real_lgGroupFree(int handle, int gpio);
+int __real_lgGroupRead(int handle, int gpio, uint64_t *groupBits);
+int __real_lgGroupWrite(int handle, int gpio, uint64_t groupBits,
+                        uint64_t groupMask);
+int __real_lgGpioClaimAlert(int handle, int lFlags, int eFlags, int gpio,
+                            int nfyHandle);
+int __real_lgGpioSetAlertsFunc(int handle, int gpio, lgGpioAlertsFunc_t cbf,
+                               void *userdata);
+
+int __wrap_lgGpiochipOpen(int gpioDev) {
+  return probe(CALL_CHIP_OPEN, -1,
+               [&] { return __real_lgGpiochipOpen(gpioDev); });
+}
+
+int __wrap_lgGpiochipClose(int handle) {
+  return probe(CALL_CHIP_CLOSE, -1,
+               [&] { return __real_lgGpiochipClose(handle); });
+}
+
+int __wrap_lgGpioClaimInput(int handle, int lFlags, int gpio) {
+  return probe(CALL_CLAIM_INPUT, gpio, [&] {
+    return __real_lgGpioClaimInput(handle, lFlags, gpio);
+  });
+}
+
+int __wrap_lgGpioClaimOutput(int handle, int lFlags, int gpio, int level) {
+  return probe(CALL_CLAIM_OUTPUT, gpio, [&] {
+    return __real_lgGpioClaimOutput(handle, lFlags, gpio, level);
+  });
+}
+
+int __wrap_lgGpioFree(int handle, int gpio) {
+  return probe(CALL_FREE, gpio,
+               [&] { return __real_lgGpioFree(handle, gpio); });
+}
+
+int __wrap_lgGpioRead(int handle, int gpio) {
+  return probe(CALL_READ, gpio,
+               [&] { return __real_lgGpioRead(handle, gpio); });
+}
+
+int __wrap_lgGpioWrite(int handle, int gpio, int level) {
+  return probe(CALL_WRITE, gpio,
+               [&] { return __real_lgGpioWrite(handle, gpio, level); });
+}
+
+int __wrap_lgTxPwm(int handle, int gpio, float pwmFrequency,
+                   float pwmDutyCycle, int pwmOffset, int pwmCycles) {
+  return probe(CALL_TX_PWM, gpio, [&] {
+    return __real_lgTxPwm(handle, gpio, pwmFrequency, pwmDutyCycle,
+                          pwmOffset, pwmCycles);
+  });
+}
+
+int __wrap_lgTxServo(int handle, int gpio, int pulseWidth, int servoFrequency,
+                     int servoOffset, int servoCycles) {
+  return probe(CALL_TX_SERVO, gpio, [&] {
+    return __real_lgTxServo(handle, gpio, pulseWidth, servoFrequency,
+                            servoOffset, servoCycles);
+  });
+}
+
+int __wrap_lgGroupClaimInput(int handle, int lFlags, int count,
+                             const int *gpios) {
+  return probe(CALL_GROUP_CLAIM_INPUT, count > 0 ? gpios[0] : -1, [&] {
+    return __real_lgGroupClaimInput(handle, lFlags, count, gpios);
+  });
+}
+
+int __wrap_lgGroupClaimOutput(int handle, int lFlags, int count,
+                              const int *gpios, const int *levels) {
+  return probe(CALL_GROUP_CLAIM_OUTPUT, count > 0 ? gpios[0] : -1, [&] {
+    return __real_lgGroupClaimOutput(handle, lFlags, count, gpios, levels);
+  });
+}
+
+int __wrap_lgGroupFree(int handle, int gpio) {
+  return probe(CALL_GROUP_FREE, gpio,
+               [&] { return __real_lgGroupFree(handle, gpio); });
+}
+
+int __wrap_lgGroupRead(int handle, int gpio, uint64_t *groupBits) {
+  return probe(CALL_GROUP_READ, gpio,
+               [&] { return __real_lgGroupRead(handle, gpio, groupBits); });
+}
+
+int __wrap_lgGroupWrite(int handle, int gpio, uint64_t groupBits,
+                        uint64_t groupMask) {
+  return probe(CALL_GROUP_WRITE, gpio, [&] {
+    return __real_lgGroupWrite(handle, gpio, groupBits, groupMask);
+  });
+}
+
+int __wrap_lgGpioClaimAlert(int handle, int lFlags, int eFlags, int gpio,
+                            int nfyHandle) {
+  return probe(CALL_CLAIM_ALERT, gpio, [&] {
+    return __real_lgGpioClaimAlert(handle, lFlags, eFlags, gpio, nfyHandle);
+  });
+}
+
+int __wrap_lgGpioSetAlertsFunc(int handle, int gpio, lgGpioAlertsFunc_t cbf,
+                               void *userdata) {
+  return probe(CALL_SET_ALERTS_FUNC, gpio, [&] {
+    return __real_lgGpioSetAlertsFunc(handle, gpio, cbf, userdata);
+  });
+}
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// Latency of every lgpio call the project makes, per function and pin.
+// Linked in with -Wl,--wrap for each call (see build-test.sh), turned on
+// with TOY_CAR_GPIO_PROBE=1. Turned off a call costs one extra branch.
+
+// The threads making lgpio calls must have stopped before the report.
+// Weak, so binaries built without the probe still link.
+void gpio_probe_report() __attribute__((weak));
@@ -0,0 +1,277 @@
+#include "grid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char GRID_MAGIC[8] = {'T', 'O', 'Y', 'G', 'R', 'I', 'D', 0};
+// 2 keeps the car pose in the header
+static const uint32_t GRID_VERSION = 2;
+
+static size_t grid_size(uint32_t tiles_x, uint32_t tiles_y) {
+  return sizeof(GridHeader) + (size_t)tiles_x * tiles_y * GRID_TILE_CELLS;
+}
+
+static bool header_valid(const GridHeader *h, size_t size) {
+  return memcmp(h->magic, GRID_MAGIC, sizeof(GRID_MAGIC)) == 0 &&
+         h->version == GRID_VERSION && h->tiles_x > 0 && h->tiles_y > 0 &&
+         h->resolution > 0 && grid_size(h->tiles_x, h->tiles_y) == size;
+}
+
+OccupancyGrid::~OccupancyGrid() { close(); }
+
+void OccupancyGrid::close() {
+  if (base_) {
+    munmap(base_, size_);
+    base_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+int OccupancyGrid::open(const std::string &path, double width_m,
+                        double height_m, double resolution) {
+  static_assert(sizeof(GridHeader) == 64, "tiles must stay line aligned");
+  close();
+  uint32_t cells_x = static_cast<uint32_t>(std::ceil(width_m / resolution));
+  uint32_t cells_y = static_cast<uint32_t>(std::ceil(height_m / resolution));
+  uint32_t tiles_x = (cells_x + GRID_TILE_SIDE - 1) >> GRID_TILE_SHIFT;
+  uint32_t tiles_y = (cells_y + GRID_TILE_SIDE - 1) >> GRID_TILE_SHIFT;
+
+  bool fresh = true;
+  if (path.empty()) {
+    size_ = grid_size(tiles_x, tiles_y);
+    base_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  } else {
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+      return -1;
+    }
+    struct stat st;
+    if (fstat(fd_, &st)) {
+      close();
+      return -1;
+    }
+    if ((size_t)st.st_size >= sizeof(GridHeader)) {
+      GridHeader h;
+      if (pread(fd_, &h, sizeof(h), 0) == sizeof(h) &&
+          header_valid(&h, st.st_size) && h.pose_valid) {
+        size_ = st.st_size;
+        fresh = false;
+      }
+    }
+    if (fresh) {
+      size_ = grid_size(tiles_x, tiles_y);
+      if (ftruncate(fd_, 0) || ftruncate(fd_, size_)) {
+        close();
+        return -1;
+      }
+    }
+    base_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  }
+  if (base_ == MAP_FAILED) {
+    base_ = nullptr;
+    close();
+    return -1;
+  }
+
+  header_ = static_cast<GridHeader *>(base_);
+  cells_ = static_cast<int8_t *>(base_) + sizeof(GridHeader);
+  if (fresh) {
+    memset(header_, 0, sizeof(GridHeader));
+    memcpy(header_->magic, GRID_MAGIC, sizeof(GRID_MAGIC));
+    header_->version = GRID_VERSION;
+    header_->tiles_x = tiles_x;
+    header_->tiles_y = tiles_y;
+    header_->resolution = resolution;
+    header_->origin_x = -0.5 * (tiles_x << GRID_TILE_SHIFT) * resolution;
+    header_->origin_y = -0.5 * (tiles_y << GRID_TILE_SHIFT) * resolution;
+  } else {
+    std::cout << "grid: loaded " << path << std::endl;
+  }
+  width_ = header_->tiles_x << GRID_TILE_SHIFT;
+  height_ = header_->tiles_y << GRID_TILE_SHIFT;
+  return 0;
+}
+
+bool OccupancyGrid::saved_pose(Pose *pose) const {
+  if (!header_ || !header_->pose_valid) {
+    return false;
+  }
+  pose->x = header_->pose_x;
+  pose->y = header_->pose_y;
+  pose->theta = header_->pose_theta;
+  return true;
+}
+
+void OccupancyGrid::save_pose(const Pose *pose) {
+  if (!header_) {
+    return;
+  }
+  if (pose) {
+    header_->pose_x = pose->x;
+    header_->pose_y = pose->y;
+    header_->pose_theta = pose->theta;
+  }
+  header_->pose_valid = pose != nullptr;
+}
+
+void OccupancyGrid::clear() {
+  if (!header_) {
+    return;
+  }
+  memset(cells_, 0, size_ - sizeof(GridHeader));
+  header_->pose_valid = 0;
+  // more than the log holds, incremental users start over
+  changes_n_ = GRID_MAX_CHANGES + 1;
+}
+
+int OccupancyGrid::sync() {
+  if (fd_ < 0 || !base_) {
+    return 0;
+  }
+  return msync(base_, size_, MS_ASYNC);
+}
+
+bool OccupancyGrid::world_to_cell(double x, double y, int32_t *cx,
+                                  int32_t *cy) const {
+  double fx = (x - header_->origin_x) / header_->resolution;
+  double fy = (y - header_->origin_y) / header_->resolution;
+  if (fx < 0 || fy < 0 || fx >= width_ || fy >= height_) {
+    return false;
+  }
+  *cx = static_cast<int32_t>(fx);
+  *cy = static_cast<int32_t>(fy);
+  return true;
+}
+
+void OccupancyGrid::cell_to_world(int32_t cx, int32_t cy, double *x,
+                                  double *y) const {
+  *x = header_->origin_x + (cx + 0.5) * header_->resolution;
+  *y = header_->origin_y + (cy + 0.5) * header_->resolution;
+}
+
+uint32_t OccupancyGrid::trace(int32_t x0, int32_t y0, int32_t x1,
+                              int32_t y1) {
+  // bresenham, the end cell is not included
+  int32_t dx = std::abs(x1 - x0);
+  int32_t dy = -std::abs(y1 - y0);
+  int32_t sx = x0 < x1 ? 1 : -1;
+  int32_t sy = y0 < y1 ? 1 : -1;
+  int32_t err = dx + dy;
+  uint32_t n = 0;
+  while ((x0 != x1 || y0 != y1) && n < GRID_MAX_RAY) {
+    ray_[n++] = offset(x0, y0);
+    int32_t e2 = 2 * err;
+    if (e2 >= dy) {
+      err += dy;
+      x0 += sx;
+    }
+    if (e2 <= dx) {
+      err += dx;
+      y0 += sy;
+    }
+  }
+  return n;
+}
+
+// 16 cells per instruction: SSE2 on x86, NEON on the Pi
+typedef int8_t cells16 __attribute__((vector_size(16)));
+
+void OccupancyGrid::apply(const uint32_t *index, uint32_t count,
+                          int8_t delta) {
+  // the cells are bytes scattered by index, which neither NEON nor plain
+  // x86 can gather: collect them into a line, update the line 16 at a
+  // time, and put them back
+  static_assert(LOGODDS_MAX + LOGODDS_HIT <= INT8_MAX &&
+                    LOGODDS_MIN + LOGODDS_MISS >= INT8_MIN,
+                "a step from the limits must not wrap before the clamp");
+  while (count > 0) {
+    uint32_t n = std::min<uint32_t>(count, GRID_MAX_RAY);
+    for (uint32_t i = 0; i < n; i++) {
+      line_[i] = cells_[index[i]];
+    }
+    for (uint32_t i = 0; i < n; i += 16) {
+      cells16 old, v;
+      memcpy(&old, line_ + i, sizeof(old));
+      v = old + delta;
+      v = v > LOGODDS_MAX ? LOGODDS_MAX : v;
+      v = v < LOGODDS_MIN ? LOGODDS_MIN : v;
+      // -1 in the lanes whose occupancy flipped
+      cells16 flip = (old > LOGODDS_OCCUPIED) != (v > LOGODDS_OCCUPIED);
+      memcpy(line_ + i, &v, sizeof(v));
+      memcpy(flip_ + i, &flip, sizeof(flip));
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      cells_[index[i]] = line_[i];
+      // log occupancy flips for incremental planners, the slot is always
+      // written and only kept when the cell flipped
+      changes_[std::min<uint32_t>(changes_n_, GRID_MAX_CHANGES)] = index[i];
+      changes_n_ += flip_[i] & 1;
+    }
+    index += n;
+    count -= n;
+  }
+}
+
+void OccupancyGrid::cell_of(uint32_t offset, int32_t *cx,
+                            int32_t *cy) const {
+  uint32_t tile = offset >> (2 * GRID_TILE_SHIFT);
+  uint32_t inner = offset & (GRID_TILE_CELLS - 1);
+  *cx = ((tile % header_->tiles_x) << GRID_TILE_SHIFT) |
+        (inner & (GRID_TILE_SIDE - 1));
+  *cy = ((tile / header_->tiles_x) << GRID_TILE_SHIFT) |
+        (inner >> GRID_TILE_SHIFT);
+}
+
+bool OccupancyGrid::changes(const uint32_t **offsets,
+                            uint32_t *count) const {
+  *offsets = changes_;
+  *count = std::min<uint32_t>(changes_n_, GRID_MAX_CHANGES);
+  return changes_n_ <= GRID_MAX_CHANGES;
+}
+
+void OccupancyGrid::integrate(const Pose &pose, double bearing,
+                              double range) {
+  if (!base_ || range <= 0) {
+    return;
+  }
+  bool hit = range < max_range_;
+  range = std::min(range, max_range_);
+  double a = pose.theta + bearing;
+  int32_t x0, y0, x1, y1;
+  if (!world_to_cell(pose.x, pose.y, &x0, &y0)) {
+    return;
+  }
+  double ex = pose.x + range * std::cos(a);
+  double ey = pose.y + range * std::sin(a);
+  if (!world_to_cell(ex, ey, &x1, &y1)) {
+    // 打到地图外面了，只更新地图内的空闲部分
+    hit = false;
+    ex = std::min<double>(std::max<double>(ex, header_->origin_x),
+                          header_->origin_x + (width_ - 1) * resolution());
+    ey = std::min<double>(std::max<double>(ey, header_->origin_y),
+                          header_->origin_y + (height_ - 1) * resolution());
+    world_to_cell(ex, ey, &x1, &y1);
+  }
+  uint32_t n = trace(x0, y0, x1, y1);
+  apply(ray_, n, LOGODDS_MISS);
+  if (hit) {
+    uint32_t end = offset(x1, y1);
+    apply(&end, 1, LOGODDS_HIT);
+  }
+}
+
+void OccupancyGrid::integrate(const Pose &pose, const ScanProfile &scan) {
+  for (uint32_t i = 0; i < scan.count; i++) {
+    // scanner angles are clockwise positive
+    integrate(pose, -scan.angle_deg[i] * M_PI / 180, scan.range_m[i]);
+  }
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "pose.h"
+#include "scanner.h"
+#include <stdint.h>
+#include <string>
+
+#define GRID_TILE_SHIFT 3
+#define GRID_TILE_SIDE (1 << GRID_TILE_SHIFT)
+#define GRID_TILE_CELLS (GRID_TILE_SIDE * GRID_TILE_SIDE) /*one cache line*/
+#define GRID_MAX_RAY 1024
+#define GRID_MAX_CHANGES 4096
+
+// On-disk and in-memory layout are the same: this header, padded to a cache
+// line, followed by the tiles in row-major tile order. Each tile holds 8x8
+// cells of log-odds, row-major inside the tile.
+struct GridHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t tiles_x;
+  uint32_t tiles_y;
+  float resolution;
+  float origin_x;
+  float origin_y;
+  // where the car was when the map was last written, the map is only
+  // worth loading if the next run starts from there
+  float pose_x;
+  float pose_y;
+  float pose_theta;
+  uint32_t pose_valid;
+  uint8_t reserved[16];
+};
+
+// Probabilistic occupancy grid. Log-odds are kept as int8 in 1/16 units.
+class OccupancyGrid {
+public:
+  static const int8_t LOGODDS_MIN = -100;
+  static const int8_t LOGODDS_MAX = 100;
+  static const int8_t LOGODDS_HIT = 14;
+  static const int8_t LOGODDS_MISS = -6;
+  static const int8_t LOGODDS_OCCUPIED = 20;
+
+  OccupancyGrid() {}
+  ~OccupancyGrid();
+  // Maps the grid file at path, the map is centered on the start pose. A
+  // valid file with a saved pose is used as it is, whatever size was asked
+  // for; a missing, incompatible or unplaced one is created. An empty path keeps the map in memory.
+  int open(const std::string &path, double width_m, double height_m,
+           double resolution);
+  // Flushes the mapping to the file.
+  int sync();
+  // The car pose the map was left with. Returns false if there is none,
+  // the map then cannot be placed and should not be used.
+  bool saved_pose(Pose *pose) const;
+  // Records pose as the one to start the next run from, or with a null
+  // pose that nobody knows where the car is.
+  void save_pose(const Pose *pose);
+  // Forgets every cell, for a car that lost track of where it is.
+  void clear();
+  // One sonar reading. bearing is in radians relative to the car heading,
+  // counter-clockwise positive.
+  void integrate(const Pose &pose, double bearing, double range);
+  // Every reading of a panning sonar sweep taken at pose.
+  void integrate(const Pose &pose, const ScanProfile &scan);
+
+  bool world_to_cell(double x, double y, int32_t *cx, int32_t *cy) const;
+  void cell_to_world(int32_t cx, int32_t cy, double *x, double *y) const;
+  int8_t at(int32_t cx, int32_t cy) const { return cells_[offset(cx, cy)]; }
+  bool occupied(int32_t cx, int32_t cy) const {
+    return at(cx, cy) > LOGODDS_OCCUPIED;
+  }
+  void cell_of(uint32_t offset, int32_t *cx, int32_t *cy) const;
+  // Cells whose occupied() flipped since the last clear_changes(), as cell
+  // offsets. Returns false if more cells changed than the log holds.
+  bool changes(const uint32_t **offsets, uint32_t *count) const;
+  void clear_changes() { changes_n_ = 0; }
+  uint32_t width() const { return width_; }
+  uint32_t height() const { return height_; }
+  double resolution() const { return header_->resolution; }
+
+private:
+  uint32_t offset(int32_t cx, int32_t cy) const {
+    uint32_t tile = (cy >> GRID_TILE_SHIFT) * header_->tiles_x +
+                    (cx >> GRID_TILE_SHIFT);
+    return (tile << (2 * GRID_TILE_SHIFT)) |
+           ((cy & (GRID_TILE_SIDE - 1)) << GRID_TILE_SHIFT) |
+           (cx & (GRID_TILE_SIDE - 1));
+  }
+  uint32_t trace(int32_t x0, int32_t y0, int32_t x1, int32_t y1);
+  // index must not repeat a cell, a ray's cells never do
+  void apply(const uint32_t *index, uint32_t count, int8_t delta);
+  void close();
+
+private:
+  int fd_{-1};
+  size_t size_{0};
+  void *base_{nullptr};
+  GridHeader *header_{nullptr};
+  int8_t *cells_{nullptr};
+  uint32_t width_{0};
+  uint32_t height_{0};
+  double max_range_{4.0};
+  // cell offsets of the ray being integrated
+  uint32_t ray_[GRID_MAX_RAY];
+  // apply()'s cells gathered into a line, padded to whole vectors
+  alignas(16) int8_t line_[GRID_MAX_RAY + 16];
+  alignas(16) int8_t flip_[GRID_MAX_RAY + 16];
+  uint32_t changes_[GRID_MAX_CHANGES + 1];
+  uint32_t changes_n_{0};
+};
@@ -0,0 +1,66 @@
+#include "histogram.h"
+#include <algorithm>
+
+uint32_t Histogram::bucket_of(uint64_t value) {
+  if (value < SUB_BUCKETS) {
+    return static_cast<uint32_t>(value);
+  }
+  uint32_t msb = 63 - __builtin_clzll(value);
+  uint32_t shift = msb - SUB_BITS;
+  return (shift + 1) * SUB_BUCKETS +
+         static_cast<uint32_t>((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+uint64_t Histogram::bucket_top(uint32_t bucket) {
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+  uint32_t shift = bucket / SUB_BUCKETS - 1;
+  uint64_t low = static_cast<uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS)
+                 << shift;
+  return low + ((1ULL << shift) - 1);
+}
+
+void Histogram::add(uint64_t value) {
+  buckets_[bucket_of(value)]++;
+  count_++;
+  sum_ += value;
+  min_ = std::min(min_, value);
+  max_ = std::max(max_, value);
+}
+
+void Histogram::merge(const Histogram &other) {
+  for (uint32_t i = 0; i < BUCKETS; i++) {
+    buckets_[i] += other.buckets_[i];
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+}
+
+void Histogram::reset() {
+  for (uint32_t i = 0; i < BUCKETS; i++) {
+    buckets_[i] = 0;
+  }
+  count_ = 0;
+  sum_ = 0;
+  min_ = UINT64_MAX;
+  max_ = 0;
+}
+
+uint64_t Histogram::percentile(double p) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  uint64_t rank = static_cast<uint64_t>(p / 100.0 * count_ + 0.5);
+  rank = std::max<uint64_t>(1, std::min(rank, count_));
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < BUCKETS; i++) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      return std::min(bucket_top(i), max_);
+    }
+  }
+  return max_;
+}
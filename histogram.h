@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+
+// Log-linear histogram of unsigned values: exact below 16, then 16 buckets
+// per power of two, so a percentile is off by at most 1/16. Fixed size,
+// adding never allocates.
+class Histogram {
+public:
+  Histogram() { reset(); }
+  ~Histogram() {}
+  void add(uint64_t value);
+  void merge(const Histogram &other);
+  void reset();
+  uint64_t count() const { return count_; }
+  uint64_t sum() const { return sum_; }
+  uint64_t min() const { return count_ ? min_ : 0; }
+  uint64_t max() const { return max_; }
+  // Upper bound of the bucket holding the p-th percentile, p in [0, 100].
+  uint64_t percentile(double p) const;
+
+private:
+  static const uint32_t SUB_BITS = 4;
+  static const uint32_t SUB_BUCKETS = 1 << SUB_BITS;
+  static const uint32_t BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+  static uint32_t bucket_of(uint64_t value);
+  static uint64_t bucket_top(uint32_t bucket);
+
+private:
+  uint64_t buckets_[BUCKETS];
+  uint64_t count_;
+  uint64_t sum_;
+  uint64_t min_;
+  uint64_t max_;
+};
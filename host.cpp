@@ -0,0 +1,112 @@
+// Runs one commander in a process of its own and pushes its commands to a
+// running toy_car through the shared memory ring. The commander can block,
+// stall or crash here, the car's loop never waits for it: without fresh
+// commands it falls back to its own inputs, and a command that runs out
+// brakes.
+#include "arena.h"
+#include "cmd_ring.h"
+#include "commander.h"
+#include "deadline.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <signal.h>
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_stop(int sig) { stop_requested = 1; }
+
+static void sleep_until(uint64_t when) {
+  uint64_t now = monotonic_ns();
+  if (when <= now) {
+    return;
+  }
+  struct timespec wait;
+  wait.tv_sec = (when - now) / 1000000000ULL;
+  wait.tv_nsec = (when - now) % 1000000000ULL;
+  nanosleep(&wait, nullptr);
+}
+
+int main(int argc, char **argv) {
+  double period = 0.1;
+  const char *type = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--period") && i + 1 < argc) {
+      period = atof(argv[++i]);
+    } else if (!type && argv[i][0] != '-') {
+      type = argv[i];
+    } else {
+      type = nullptr;
+      break;
+    }
+  }
+  if (!type || period <= 0) {
+    printf("usage: %s [--period SECONDS] joystick|terminal|infrared\n",
+           argv[0]);
+    return 1;
+  }
+  // no SA_RESTART, a blocked terminal read has to give up too
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_stop;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+
+  ArenaResource *arena = control_arena();
+  std::unique_ptr<Commander, void (*)(Commander *)> commander(
+      make_commander(type, arena), destroy_commander);
+  if (!commander) {
+    printf("unknown commander %s\n", type);
+    return 1;
+  }
+  CmdRing *ring = nullptr;
+  while (!stop_requested && !(ring = cmd_ring_producer_open())) {
+    // no car yet, or another host still feeds it
+    printf("waiting for the command ring %s\n", CMD_RING_SHM);
+    sleep_until(monotonic_ns() + 1000000000ULL);
+  }
+  if (!ring) {
+    return 0;
+  }
+  printf("%s commands go to the car\n", type);
+
+  uint64_t period_ns = static_cast<uint64_t>(period * 1e9);
+  uint64_t next = monotonic_ns();
+  uint64_t pushed = 0;
+  uint64_t dropped = 0;
+  while (!stop_requested) {
+    std::string word = commander->scan_cmd();
+    RingCommand cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.seq = pushed + dropped + 1;
+    snprintf(cmd.cmd, sizeof(cmd.cmd), "%s", word.c_str());
+    cmd.stamp = commander->cmd_stamp();
+    cmd.deadline = commander->cmd_deadline();
+    cmd.has_engine =
+        commander->engine_hint(&cmd.engine[0], &cmd.engine[1], &cmd.engine[2]);
+    cmd.has_drive = commander->drive_hint(&cmd.drive[0], &cmd.drive[1]);
+    cmd.sent_ns = monotonic_ns();
+    if (cmd.deadline == 0) {
+      // the car must not keep running a command of a host that went quiet
+      cmd.deadline = cmd.sent_ns + 3 * period_ns;
+    }
+    if (cmd_ring_push(ring, cmd)) {
+      pushed++;
+    } else {
+      dropped++;
+    }
+    next += period_ns;
+    if (next < monotonic_ns()) {
+      // a commander that blocked does not get a burst of catch up ticks
+      next = monotonic_ns();
+    }
+    sleep_until(next);
+  }
+  cmd_ring_close(ring);
+  printf("pushed %lu commands, %lu dropped with the ring full\n",
+         static_cast<unsigned long>(pushed),
+         static_cast<unsigned long>(dropped));
+  return 0;
+}
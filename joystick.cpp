@@ -14,6 +14,7 @@
 
 #include "joystick.h"
 
+#include <cerrno>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -55,7 +56,15 @@ bool Joystick::sample(JoystickEvent* event)
   int bytes = read(_fd, event, sizeof(*event)); 
 
   if (bytes == -1)
+  {
+    // unplugged, isFound() says so from now on
+    if (errno == ENODEV)
+    {
+      close(_fd);
+      _fd = -1;
+    }
     return false;
+  }
 
   // NOTE if this condition is not met, we're probably out of sync and this
   // Joystick instance is likely unusable
@@ -147,6 +147,7 @@ public:
   /**
    * Attempts to populate the provided JoystickEvent instance with data
    * from the joystick. Returns true if data is available, otherwise false.
+   * Closes the device once it is gone.
    */
   bool sample(JoystickEvent* event);
 };
@@ -1,71 +1,176 @@
 
+#include "alloc_audit.h"
+#include "arena.h"
+#include "car_state.h"
 #include "commander.h"
+#include "deadline.h"
+#include "dispatch.h"
+#include "gpio_probe.h"
+#include "histogram.h"
+#include "perf_counters.h"
+#include "telemetry.h"
+#include "trace.h"
 #include <iostream>
+#include <signal.h>
 #include <unistd.h>
 
 
 extern "C" {
 #include "lgpio.h"
 }
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
-#include <unordered_map>
 #include "car.h"
 
 
+#define LOG_BUFFER_BYTES 4096
+#define TICK_NS 100000000ULL
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_stop(int sig) { stop_requested = 1; }
+
+static void on_deadline(void *car) { static_cast<Car *>(car)->stop(); }
+
+static void latency_report(const Histogram &latency) {
+  PhaseScope log(PHASE_LOG);
+  std::cout << "stick to wheel latency: " << latency.count()
+            << " commands, p50 " << latency.percentile(50) / 1000000.0
+            << "ms p99 " << latency.percentile(99) / 1000000.0 << "ms max "
+            << latency.max() / 1000000.0 << "ms" << std::endl;
+}
+
 int main() {
-  Car my_car;
+  // Ctrl-C ends the loop so the car brakes and the reports get printed. No
+  // SA_RESTART, a blocked terminal read has to give up too.
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_stop;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+
+  // all long-lived control state comes from one block, the loop itself
+  // should never reach the heap
+  ArenaResource *arena = control_arena();
+  setvbuf(stdout, static_cast<char *>(arena->allocate(LOG_BUFFER_BYTES)),
+          _IOLBF, LOG_BUFFER_BYTES);
+  Car &my_car = *arena_new<Car>(arena);
   int rc = my_car.init();
   if (rc) {
     std::cout << "failed to init my car, rc:" << rc << std::endl;
     return rc;
   }
   std::unique_ptr<Commander, void (*)(Commander *)> js_commander(
-      make_commander("joystick"), destroy_commander);
+      make_commander("joystick", arena), destroy_commander);
   std::unique_ptr<Commander, void (*)(Commander *)> sn_commander(
-      make_commander("sonar"), destroy_commander);
+      make_commander("sonar", arena), destroy_commander);
   std::unique_ptr<Commander, void (*)(Commander *)> tm_commander(
-      make_commander("terminal"), destroy_commander);
+      make_commander("terminal", arena), destroy_commander);
+  // commanders run by toy_car_host in a process of their own
+  std::unique_ptr<Commander, void (*)(Commander *)> rg_commander(
+      make_commander("ring", arena), destroy_commander);
+  // external planners, see control.h and toy_car_ctl
+  std::unique_ptr<Commander, void (*)(Commander *)> ctl_commander(
+      make_commander("socket", arena), destroy_commander);
+  // phase hooks go in before the sonar thread below enters a phase
+  const char *trace_path = trace_wanted();
+  if (trace_path) {
+    trace_start();
+  }
 
-  while (true) {
-    // 保持一定的控制周期
-    lguSleep(0.1);
+  bool perf = perf_wanted();
+  if (perf && perf_start()) {
+    std::cout << "perf counters not available" << std::endl;
+    perf = false;
+  }
+
+  // a close obstacle brakes the car straight from the sonar thread,
+  // TOY_CAR_ESTOP=0 turns it off
+  const char *estop = getenv("TOY_CAR_ESTOP");
+  double estop_m = estop ? atof(estop) : 0.15;
+  if (estop_m > 0 && sn_commander->set_emergency_stop(&my_car, estop_m)) {
+    std::cout << "no sonar emergency stop" << std::endl;
+  }
+  std::cout << "control arena: " << arena->used() << " of "
+            << arena->capacity() << " bytes" << std::endl;
 
-    // 命令输入提示
-    std::cout << std::endl << std::endl;
-    std::cout << "...........等待输入指令left(l)/right(r)/forward(f)/"
-                 "backward(b)/brake(*)....."
+  // brakes when a command outlives its deadline, also while the loop
+  // waits for the terminal
+  Watchdog watchdog(on_deadline, &my_car);
+  watchdog.start();
+
+  // live state for toy_car_top, one copy into shared memory per tick
+  CarStatePage *state_page = car_state_publish_open();
+  if (!state_page) {
+    std::cout << "failed to open shared memory " << CAR_STATE_SHM
               << std::endl;
-    std::string cmd = js_commander->scan_cmd();
-    if (cmd == "auto_sonar") {
-      cmd = sn_commander->scan_cmd();
-      my_car.set_engine(20, 20, 70);
-      std::cout << "using sonar cmd:" << cmd << std::endl;
-    }else if (cmd == "fallback_terminal") {
-      cmd = tm_commander->scan_cmd();
-      my_car.set_engine(90, 40, 40);
-      std::cout << "using fallback terminal cmd:" << cmd << std::endl;
-    }else {
-      my_car.set_engine(90, 40, 40);
+  }
+  // the same state as UDP frames, TOY_CAR_TELEMETRY=[ADDR:]PORT or 1 for
+  // the loopback default, TOY_CAR_TELEMETRY_HZ frames per second
+  TelemetrySender telemetry;
+  const char *telemetry_dest = getenv("TOY_CAR_TELEMETRY");
+  if (telemetry_dest) {
+    const char *hz = getenv("TOY_CAR_TELEMETRY_HZ");
+    if (telemetry.open(strcmp(telemetry_dest, "1") ? telemetry_dest : "",
+                       hz ? atof(hz) : TELEMETRY_DEFAULT_HZ)) {
+      std::cout << "bad telemetry destination " << telemetry_dest
+                << std::endl;
     }
+  }
 
-    if (cmd == "left" || cmd == "l") {
-      std::cout << "............普通左转100ms............" << std::endl;
-      my_car.turn_left();
-    } else if (cmd == "right" || cmd == "r") {
-      std::cout << "............普通右转100ms............" << std::endl;
-      my_car.turn_right();
-    } else if (cmd == "forward" || cmd == "f") {
-      std::cout << "............前进100ms................" << std::endl;
-      my_car.move_forward();
-    } else if (cmd == "backward" || cmd == "b") {
-      std::cout << "............后退100ms................" << std::endl;
-      my_car.move_backward();
-    } else {
-      std::cout << "............刹车..............." << std::endl;
-      my_car.brake();
+  CommandSources sources = {js_commander.get(), sn_commander.get(),
+                            tm_commander.get(), rg_commander.get(),
+                            ctl_commander.get()};
+  ControlLoop loop(sources, &my_car, &watchdog, TICK_NS);
+  loop.publish_to(state_page, &telemetry);
+  AllocStats window_start;
+  alloc_stats_all(&window_start);
+  while (!stop_requested) {
+    loop.tick();
+
+    // the loop should not touch the heap once it is running, nor should
+    // the sonar guard or the watchdog: say where any of them still does
+    if (loop.ticks() % 100 == 0) {
+      AllocStats now, window;
+      alloc_stats_all(&now);
+      alloc_diff(window_start, now, &window);
+      alloc_report("heap use in the last 100 ticks:", window);
+      window_start = now;
+      if (my_car.input_latency().count()) {
+        latency_report(my_car.input_latency());
+      }
+    }
+    if (perf) {
+      perf_tick();
     }
   }
   // 结束
+  watchdog.stop();
+  // the sonar thread is done before its trace buffer is read
+  sn_commander.reset();
+  my_car.brake();
+  std::cout << "stale commands refused: " << loop.stale()
+            << ", braked by the watchdog: " << watchdog.fired() << std::endl;
+  if (my_car.input_latency().count()) {
+    latency_report(my_car.input_latency());
+  }
+  if (telemetry.is_open()) {
+    std::cout << "telemetry frames sent: " << telemetry.sent()
+              << ", dropped: " << telemetry.dropped() << std::endl;
+  }
+  if (perf) {
+    perf_report();
+    perf_stop();
+  }
+  if (gpio_probe_report) {
+    gpio_probe_report();
+  }
+  if (trace_path && trace_stop(trace_path)) {
+    std::cout << "failed to write trace " << trace_path << std::endl;
+  }
   return 0;
 }
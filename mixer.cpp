@@ -0,0 +1,43 @@
+#include "mixer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+DriveMixer::DriveMixer(double dead_zone, double expo) {
+  const int size = 1 << TABLE_BITS;
+  const int step = 65536 / size;
+  for (int i = 0; i < size; i++) {
+    // middle of the stick range this entry stands for
+    double v = (i * step - 32768 + step / 2) / 32767.0;
+    double a = std::min(1.0, std::fabs(v));
+    a = a <= dead_zone ? 0 : (a - dead_zone) / (1 - dead_zone);
+    a = (1 - expo) * a + expo * a * a * a;
+    shape_[i] = static_cast<int16_t>(std::lround(std::copysign(a, v) *
+                                                 (1 << ONE)));
+  }
+}
+
+// rounded, so the last table entry still reaches full duty
+int32_t DriveMixer::to_duty(int32_t v) {
+  const int32_t half = 1 << (ONE - 1);
+  return (v * 100 + (v < 0 ? -half : half)) / (1 << ONE);
+}
+
+void DriveMixer::mix(int throttle, int turn, int32_t *left,
+                     int32_t *right) const {
+  const int shift = 16 - TABLE_BITS;
+  throttle = std::max(-32767, std::min(32767, throttle));
+  turn = std::max(-32767, std::min(32767, turn));
+  int32_t t = shape_[(throttle + 32768) >> shift];
+  int32_t r = shape_[(turn + 32768) >> shift];
+  int32_t l = t + r;
+  int32_t rr = t - r;
+  // past full duty on one side, scale both down to keep the turn radius
+  int32_t big = std::max(std::abs(l), std::abs(rr));
+  if (big > (1 << ONE)) {
+    l = l * (1 << ONE) / big;
+    rr = rr * (1 << ONE) / big;
+  }
+  *left = to_duty(l);
+  *right = to_duty(rr);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+
+// Stick position to wheel duty for skid steering. The dead zone and the
+// response curve are baked into a table when the mixer is built, so mixing
+// is a few loads and integer math.
+class DriveMixer {
+public:
+  // dead_zone is the fraction of the stick travel that counts as centred,
+  // expo blends a linear response (0) into a cubic one (1) for finer
+  // control around the centre.
+  DriveMixer(double dead_zone = 0.1, double expo = 0.5);
+  ~DriveMixer() {}
+  // throttle and turn in the js range -32767..32767, positive is forward
+  // and right. Duties are -100..100, positive drives the wheels forward.
+  void mix(int throttle, int turn, int32_t *left, int32_t *right) const;
+
+private:
+  static const int TABLE_BITS = 10;
+  // 1 << ONE is full stick
+  static const int ONE = 10;
+  static int32_t to_duty(int32_t v);
+  int16_t shape_[1 << TABLE_BITS];
+};
@@ -0,0 +1,57 @@
+// Stand-in for the parts of lgpio the car uses that accepts every call and
+// drives nothing, for measuring the control code on its own. Inputs read
+// high, so the infrared detectors see no obstacle and the sonar never
+// hears an echo. Link it instead of -llgpio.
+#include <errno.h>
+#include <time.h>
+extern "C" {
+#include "lgpio.h"
+}
+
+extern "C" {
+
+int lgGpiochipOpen(int gpioDev) { return 0; }
+
+int lgGpiochipClose(int handle) { return 0; }
+
+int lgGpioClaimInput(int handle, int lFlags, int gpio) { return 0; }
+
+int lgGpioClaimOutput(int handle, int lFlags, int gpio, int level) {
+  return 0;
+}
+
+int lgGpioFree(int handle, int gpio) { return 0; }
+
+int lgGpioRead(int handle, int gpio) { return 1; }
+
+int lgGpioWrite(int handle, int gpio, int level) { return 0; }
+
+int lgTxPwm(int handle, int gpio, float pwmFrequency, float pwmDutyCycle,
+            int pwmOffset, int pwmCycles) {
+  return 0;
+}
+
+int lgTxServo(int handle, int gpio, int pulseWidth, int servoFrequency,
+              int servoOffset, int servoCycles) {
+  return 0;
+}
+
+uint64_t lguTimestamp(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+double lguTime(void) { return lguTimestamp() / 1e9; }
+
+void lguSleep(double sleepSecs) {
+  if (sleepSecs <= 0) {
+    return;
+  }
+  struct timespec ts;
+  ts.tv_sec = static_cast<time_t>(sleepSecs);
+  ts.tv_nsec = static_cast<long>((sleepSecs - ts.tv_sec) * 1e9);
+  while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+  }
+}
+}
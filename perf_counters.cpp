@@ -0,0 +1,230 @@
+#include "perf_counters.h"
+#include "histogram.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+struct CounterDef {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+};
+
+static const CounterDef counter_defs[PERF_COUNTER_COUNT] = {
+    {"ns", 0, 0},
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"ctx-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+// threads past these go uncounted
+#define PERF_MAX_THREADS 8
+
+struct PerfThread {
+  const char *name;
+  int leader{-1};
+  int fd[PERF_COUNTER_COUNT];
+  // position of the counter in a group read, -1 if it is not open
+  int slot[PERF_COUNTER_COUNT];
+  int opened{0};
+  uint64_t last[PERF_COUNTER_COUNT];
+  uint64_t tick[PHASE_COUNT][PERF_COUNTER_COUNT];
+  uint64_t total[PHASE_COUNT][PERF_COUNTER_COUNT];
+  Histogram hist[PHASE_COUNT][PERF_COUNTER_COUNT];
+  uint64_t ticks{0};
+};
+
+static thread_local PerfThread *tls_perf = nullptr;
+// every thread with counters open, for the report
+static PerfThread *perf_threads[PERF_MAX_THREADS];
+static std::atomic<uint32_t> perf_thread_count{0};
+static std::atomic<bool> perf_on{false};
+
+static int open_counter(const CounterDef &def, int group) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = def.type;
+  attr.config = def.config;
+  attr.read_format = PERF_FORMAT_GROUP;
+  // hardware counters in user space only, that is all perf_event_paranoid
+  // 2 allows. Switches and faults only ever happen in the kernel.
+  attr.exclude_kernel = def.type == PERF_TYPE_HARDWARE;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void read_counters(PerfThread *t, uint64_t *now) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  now[PERF_NANOS] = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  uint64_t buf[1 + PERF_COUNTER_COUNT];
+  if (t->leader < 0 || read(t->leader, buf, sizeof(buf)) <= 0) {
+    buf[0] = 0;
+  }
+  for (int c = PERF_NANOS + 1; c < PERF_COUNTER_COUNT; c++) {
+    int slot = t->slot[c];
+    now[c] = slot >= 0 && static_cast<uint64_t>(slot) < buf[0]
+                 ? buf[1 + slot]
+                 : 0;
+  }
+}
+
+static void charge(PerfThread *t, LoopPhase phase) {
+  uint64_t now[PERF_COUNTER_COUNT];
+  read_counters(t, now);
+  for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+    t->tick[phase][c] += now[c] - t->last[c];
+    t->last[c] = now[c];
+  }
+}
+
+static void on_phase(LoopPhase from, LoopPhase to) {
+  if (tls_perf) {
+    charge(tls_perf, from);
+  }
+}
+
+bool perf_wanted() {
+  const char *env = getenv("TOY_CAR_PERF");
+  return env && strcmp(env, "0") != 0;
+}
+
+// Opens a group for the calling thread, quiet leaves out the counters
+// that are not there without a word.
+static int open_thread(const char *name, bool quiet) {
+  if (tls_perf) {
+    return 0;
+  }
+  uint32_t index = perf_thread_count.load();
+  if (index >= PERF_MAX_THREADS) {
+    return -1;
+  }
+  PerfThread *t = new PerfThread();
+  t->name = name;
+  for (int c = PERF_NANOS + 1; c < PERF_COUNTER_COUNT; c++) {
+    t->fd[c] = open_counter(counter_defs[c], t->leader);
+    t->slot[c] = -1;
+    if (t->fd[c] < 0) {
+      if (!quiet) {
+        printf("perf: %s not available: %s\n", counter_defs[c].name,
+               strerror(errno));
+      }
+      continue;
+    }
+    if (t->leader < 0) {
+      t->leader = t->fd[c];
+    }
+    t->slot[c] = t->opened++;
+  }
+  if (t->opened == 0) {
+    delete t;
+    return -1;
+  }
+  read_counters(t, t->last);
+  index = perf_thread_count++;
+  if (index >= PERF_MAX_THREADS) {
+    perf_thread_count--;
+    for (int c = PERF_NANOS + 1; c < PERF_COUNTER_COUNT; c++) {
+      if (t->slot[c] >= 0) {
+        close(t->fd[c]);
+      }
+    }
+    delete t;
+    return -1;
+  }
+  perf_threads[index] = t;
+  tls_perf = t;
+  return 0;
+}
+
+int perf_start() {
+  static bool hooked = false;
+  if (open_thread("loop", false)) {
+    return -1;
+  }
+  if (!hooked && add_phase_hook(on_phase) == 0) {
+    hooked = true;
+  }
+  perf_on = true;
+  return 0;
+}
+
+int perf_thread(const char *name) {
+  if (!perf_on.load(std::memory_order_relaxed)) {
+    return 0;
+  }
+  return open_thread(name, true);
+}
+
+void perf_tick() {
+  PerfThread *t = tls_perf;
+  if (!t) {
+    return;
+  }
+  charge(t, current_phase());
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+      t->hist[p][c].add(t->tick[p][c]);
+      t->total[p][c] += t->tick[p][c];
+      t->tick[p][c] = 0;
+    }
+  }
+  t->ticks++;
+}
+
+static void report_thread(const PerfThread *t) {
+  printf("perf counters of the %s thread over %lu ticks, per tick values\n",
+         t->name, static_cast<unsigned long>(t->ticks));
+  printf("%-8s %-13s %14s %12s %12s %12s %12s\n", "phase", "counter",
+         "total", "p50", "p90", "p99", "max");
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    // helper threads never enter most phases
+    if (t->total[p][PERF_NANOS] == 0) {
+      continue;
+    }
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+      if (c != PERF_NANOS && t->slot[c] < 0) {
+        continue;
+      }
+      const Histogram &h = t->hist[p][c];
+      printf("%-8s %-13s %14lu %12lu %12lu %12lu %12lu\n",
+             phase_name(static_cast<LoopPhase>(p)), counter_defs[c].name,
+             static_cast<unsigned long>(t->total[p][c]),
+             static_cast<unsigned long>(h.percentile(50)),
+             static_cast<unsigned long>(h.percentile(90)),
+             static_cast<unsigned long>(h.percentile(99)),
+             static_cast<unsigned long>(h.max()));
+    }
+  }
+}
+
+void perf_report() {
+  uint32_t n = perf_thread_count.load();
+  for (uint32_t i = 0; i < n; i++) {
+    report_thread(perf_threads[i]);
+  }
+}
+
+void perf_stop() {
+  perf_on = false;
+  tls_perf = nullptr;
+  uint32_t n = perf_thread_count.exchange(0);
+  for (uint32_t i = 0; i < n; i++) {
+    PerfThread *t = perf_threads[i];
+    for (int c = PERF_NANOS + 1; c < PERF_COUNTER_COUNT; c++) {
+      if (t->slot[c] >= 0) {
+        close(t->fd[c]);
+      }
+    }
+    delete t;
+  }
+}
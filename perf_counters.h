@@ -0,0 +1,33 @@
+#pragma once
+#include "phase.h"
+#include <stdint.h>
+
+enum PerfCounter {
+  // wall time, always there
+  PERF_NANOS = 0,
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_CACHE_MISSES,
+  PERF_CONTEXT_SWITCHES,
+  PERF_PAGE_FAULTS,
+  PERF_COUNTER_COUNT,
+};
+
+// Set TOY_CAR_PERF=1 to turn the counters on.
+bool perf_wanted();
+// Opens perf_event counters for the calling thread, the loop, and from then
+// on charges them to the loop phase the thread is in. Counters the CPU or
+// the kernel does not offer are left out. Returns -1 if none could be
+// opened.
+int perf_start();
+// The same for a helper thread started after perf_start(), under name in
+// the report. Does nothing while the counters are off.
+int perf_thread(const char *name);
+// Ends a tick of the calling thread, what each phase collected since the
+// last call becomes one sample of that phase. A helper thread's tick is
+// one round of its own loop.
+void perf_tick();
+// Totals and per tick percentiles per thread and phase. The helper threads
+// must have stopped.
+void perf_report();
+void perf_stop();
@@ -0,0 +1,38 @@
+#include "phase.h"
+
+static thread_local LoopPhase tls_phase = PHASE_IDLE;
+static PhaseHook hooks[PHASE_MAX_HOOKS];
+static uint32_t hook_count = 0;
+
+static inline void run_hooks(LoopPhase from, LoopPhase to) {
+  for (uint32_t i = 0; i < hook_count; i++) {
+    hooks[i](from, to);
+  }
+}
+
+int add_phase_hook(PhaseHook hook) {
+  if (hook_count == PHASE_MAX_HOOKS) {
+    return -1;
+  }
+  hooks[hook_count++] = hook;
+  return 0;
+}
+
+const char *phase_name(LoopPhase phase) {
+  static const char *names[PHASE_COUNT] = {"idle", "scan", "decide",
+                                           "actuate", "log"};
+  return phase < PHASE_COUNT ? names[phase] : "unknown";
+}
+
+LoopPhase current_phase() { return tls_phase; }
+
+PhaseScope::PhaseScope(LoopPhase phase) : saved_(tls_phase) {
+  tls_phase = phase;
+  run_hooks(saved_, phase);
+}
+
+PhaseScope::~PhaseScope() {
+  LoopPhase from = tls_phase;
+  tls_phase = saved_;
+  run_hooks(from, saved_);
+}
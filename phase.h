@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+
+// What one control loop tick is busy with.
+enum LoopPhase {
+  PHASE_IDLE = 0,
+  // reading commanders and sensors
+  PHASE_SCAN,
+  // turning readings into a command and engine speeds
+  PHASE_DECIDE,
+  // driving the motors
+  PHASE_ACTUATE,
+  // console output
+  PHASE_LOG,
+  PHASE_COUNT,
+};
+
+const char *phase_name(LoopPhase phase);
+// Phase of the calling thread.
+LoopPhase current_phase();
+
+// Runs on every phase change of any thread, from is the phase being left.
+typedef void (*PhaseHook)(LoopPhase from, LoopPhase to);
+#define PHASE_MAX_HOOKS 4
+// Install hooks at startup, before any thread enters a phase. Returns -1
+// when all slots are taken.
+int add_phase_hook(PhaseHook hook);
+
+// Puts the calling thread in a phase until the scope ends, scopes nest.
+class PhaseScope {
+public:
+  explicit PhaseScope(LoopPhase phase);
+  ~PhaseScope();
+
+private:
+  LoopPhase saved_;
+};
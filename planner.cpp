@@ -0,0 +1,378 @@
+#include "planner.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static const float INF = std::numeric_limits<float>::infinity();
+static const float SQRT2 = 1.41421356f;
+static const int DX[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+static const int DY[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+
+int GridPlanner::init() {
+  width_ = grid_.width();
+  height_ = grid_.height();
+  uint32_t n = width_ * height_;
+  if (n == 0) {
+    return -1;
+  }
+  inflate_ =
+      static_cast<int32_t>(std::ceil(robot_radius_ / grid_.resolution()));
+  // 计数用uint8，膨胀半径不能太大
+  inflate_ = std::min(inflate_, 7);
+  g_.assign(n, INF);
+  rhs_.assign(n, INF);
+  heap_pos_.assign(n, -1);
+  inflated_.assign(n, 0);
+  occupied_.assign(n, 0);
+  heap_.resize(n);
+  heap_size_ = 0;
+  for (uint32_t cy = 0; cy < height_; cy++) {
+    for (uint32_t cx = 0; cx < width_; cx++) {
+      if (grid_.occupied(cx, cy)) {
+        mark_cell(cx, cy, true);
+      }
+    }
+  }
+  return 0;
+}
+
+int GridPlanner::set_goal(double x, double y) {
+  int32_t cx, cy;
+  if (g_.empty() || !grid_.world_to_cell(x, y, &cx, &cy)) {
+    return -1;
+  }
+  goal_ = id(cx, cy);
+  has_goal_ = true;
+  reset_search();
+  return 0;
+}
+
+int GridPlanner::set_start(double x, double y) {
+  int32_t cx, cy;
+  if (g_.empty() || !grid_.world_to_cell(x, y, &cx, &cy)) {
+    return -1;
+  }
+  uint32_t s = id(cx, cy);
+  if (s != start_) {
+    // keys already queued stay lower bounds if km grows by the distance
+    // the car moved
+    km_ += heuristic(last_start_, s);
+    last_start_ = s;
+    start_ = s;
+  }
+  return 0;
+}
+
+void GridPlanner::reset_search() {
+  std::fill(g_.begin(), g_.end(), INF);
+  std::fill(rhs_.begin(), rhs_.end(), INF);
+  std::fill(heap_pos_.begin(), heap_pos_.end(), -1);
+  heap_size_ = 0;
+  km_ = 0;
+  last_start_ = start_;
+  rhs_[goal_] = 0;
+  heap_push(goal_, calc_key(goal_));
+}
+
+void GridPlanner::update_from_grid(OccupancyGrid &grid) {
+  const uint32_t *offsets;
+  uint32_t count;
+  if (!grid.changes(&offsets, &count)) {
+    // the change log overflowed, rebuild everything
+    grid.clear_changes();
+    std::fill(inflated_.begin(), inflated_.end(), 0);
+    std::fill(occupied_.begin(), occupied_.end(), 0);
+    bool has_goal = has_goal_;
+    has_goal_ = false;
+    for (uint32_t cy = 0; cy < height_; cy++) {
+      for (uint32_t cx = 0; cx < width_; cx++) {
+        if (grid_.occupied(cx, cy)) {
+          mark_cell(cx, cy, true);
+        }
+      }
+    }
+    has_goal_ = has_goal;
+    if (has_goal_) {
+      reset_search();
+    }
+    return;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    int32_t cx, cy;
+    grid.cell_of(offsets[i], &cx, &cy);
+    bool occ = grid.occupied(cx, cy);
+    // a cell can flip more than once between two replans
+    if (occupied_[id(cx, cy)] != occ) {
+      mark_cell(cx, cy, occ);
+    }
+  }
+  grid.clear_changes();
+}
+
+void GridPlanner::mark_cell(int32_t cx, int32_t cy, bool occupied) {
+  occupied_[id(cx, cy)] = occupied;
+  int32_t r2 = inflate_ * inflate_;
+  for (int32_t dy = -inflate_; dy <= inflate_; dy++) {
+    for (int32_t dx = -inflate_; dx <= inflate_; dx++) {
+      int32_t x = cx + dx;
+      int32_t y = cy + dy;
+      if (dx * dx + dy * dy > r2 || x < 0 || y < 0 || x >= (int32_t)width_ ||
+          y >= (int32_t)height_) {
+        continue;
+      }
+      uint32_t v = id(x, y);
+      bool was_blocked = blocked(v);
+      inflated_[v] += occupied ? 1 : -1;
+      if (!has_goal_ || was_blocked == blocked(v)) {
+        continue;
+      }
+      // every edge touching v changed cost
+      uint32_t nb[8];
+      int dirs[8];
+      uint32_t n = neighbors(v, nb, dirs);
+      for (uint32_t k = 0; k <= n; k++) {
+        uint32_t u = k < n ? nb[k] : v;
+        if (u != goal_) {
+          rhs_[u] = best_rhs(u);
+        }
+        update_vertex(u);
+      }
+    }
+  }
+}
+
+float GridPlanner::cost(uint32_t u, uint32_t v, int dir) const {
+  // only entering a blocked node is forbidden, so a car that ended up too
+  // close to an obstacle can still plan its way out
+  if (blocked(v)) {
+    return INF;
+  }
+  return dir & 1 ? SQRT2 : 1.0f;
+}
+
+float GridPlanner::heuristic(uint32_t a, uint32_t b) const {
+  float dx = std::abs((int32_t)(a % width_) - (int32_t)(b % width_));
+  float dy = std::abs((int32_t)(a / width_) - (int32_t)(b / width_));
+  return std::max(dx, dy) + (SQRT2 - 1) * std::min(dx, dy);
+}
+
+GridPlanner::Key GridPlanner::calc_key(uint32_t u) const {
+  float m = std::min(g_[u], rhs_[u]);
+  Key k = {m + heuristic(start_, u) + km_, m};
+  return k;
+}
+
+uint32_t GridPlanner::neighbors(uint32_t u, uint32_t *out, int *dirs) const {
+  int32_t cx = u % width_;
+  int32_t cy = u / width_;
+  uint32_t n = 0;
+  for (int d = 0; d < 8; d++) {
+    int32_t x = cx + DX[d];
+    int32_t y = cy + DY[d];
+    if (x < 0 || y < 0 || x >= (int32_t)width_ || y >= (int32_t)height_) {
+      continue;
+    }
+    out[n] = id(x, y);
+    dirs[n] = d;
+    n++;
+  }
+  return n;
+}
+
+float GridPlanner::best_rhs(uint32_t u) const {
+  uint32_t nb[8];
+  int dirs[8];
+  uint32_t n = neighbors(u, nb, dirs);
+  float best = INF;
+  for (uint32_t k = 0; k < n; k++) {
+    best = std::min(best, cost(u, nb[k], dirs[k]) + g_[nb[k]]);
+  }
+  return best;
+}
+
+void GridPlanner::update_vertex(uint32_t u) {
+  bool queued = heap_pos_[u] >= 0;
+  if (g_[u] != rhs_[u]) {
+    if (queued) {
+      heap_update(u, calc_key(u));
+    } else {
+      heap_push(u, calc_key(u));
+    }
+  } else if (queued) {
+    heap_remove(u);
+  }
+}
+
+bool GridPlanner::replan() {
+  if (!has_goal_) {
+    return false;
+  }
+  while (heap_size_ > 0) {
+    Key top = heap_[0].key;
+    if (!(top < calc_key(start_)) && rhs_[start_] <= g_[start_]) {
+      break;
+    }
+    uint32_t u = heap_[0].node;
+    expansions_++;
+    Key knew = calc_key(u);
+    uint32_t nb[8];
+    int dirs[8];
+    uint32_t n = neighbors(u, nb, dirs);
+    if (top < knew) {
+      heap_update(u, knew);
+    } else if (g_[u] > rhs_[u]) {
+      g_[u] = rhs_[u];
+      heap_remove(u);
+      for (uint32_t k = 0; k < n; k++) {
+        uint32_t s = nb[k];
+        if (s != goal_) {
+          rhs_[s] = std::min(rhs_[s], cost(s, u, dirs[k]) + g_[u]);
+        }
+        update_vertex(s);
+      }
+    } else {
+      float g_old = g_[u];
+      g_[u] = INF;
+      for (uint32_t k = 0; k < n; k++) {
+        uint32_t s = nb[k];
+        if (s != goal_ && rhs_[s] == cost(s, u, dirs[k]) + g_old) {
+          rhs_[s] = best_rhs(s);
+        }
+        update_vertex(s);
+      }
+      if (u != goal_) {
+        rhs_[u] = best_rhs(u);
+      }
+      update_vertex(u);
+    }
+  }
+  return rhs_[start_] < INF;
+}
+
+uint32_t GridPlanner::waypoints(Waypoint *out, uint32_t max) {
+  if (!has_goal_ || rhs_[start_] == INF || max == 0) {
+    return 0;
+  }
+  uint32_t count = 0;
+  uint32_t cur = start_;
+  int last_dir = -1;
+  for (uint32_t step = 0; cur != goal_ && step < width_ * height_; step++) {
+    uint32_t nb[8];
+    int dirs[8];
+    uint32_t n = neighbors(cur, nb, dirs);
+    float best = INF;
+    uint32_t next = cur;
+    int dir = -1;
+    for (uint32_t k = 0; k < n; k++) {
+      float c = cost(cur, nb[k], dirs[k]) + g_[nb[k]];
+      if (c < best) {
+        best = c;
+        next = nb[k];
+        dir = dirs[k];
+      }
+    }
+    if (best == INF) {
+      break;
+    }
+    // 方向变化的地方才需要一个路点
+    if (last_dir >= 0 && dir != last_dir) {
+      grid_.cell_to_world(cur % width_, cur / width_, &out[count].x,
+                          &out[count].y);
+      if (++count == max) {
+        return count;
+      }
+    }
+    last_dir = dir;
+    cur = next;
+  }
+  grid_.cell_to_world(cur % width_, cur / width_, &out[count].x,
+                      &out[count].y);
+  return count + 1;
+}
+
+void GridPlanner::heap_set(uint32_t i, const HeapEntry &e) {
+  heap_[i] = e;
+  heap_pos_[e.node] = i;
+}
+
+void GridPlanner::sift_up(uint32_t i) {
+  HeapEntry e = heap_[i];
+  while (i > 0) {
+    uint32_t parent = (i - 1) / 2;
+    if (!(e.key < heap_[parent].key)) {
+      break;
+    }
+    heap_set(i, heap_[parent]);
+    i = parent;
+  }
+  heap_set(i, e);
+}
+
+void GridPlanner::sift_down(uint32_t i) {
+  HeapEntry e = heap_[i];
+  while (true) {
+    uint32_t child = 2 * i + 1;
+    if (child >= heap_size_) {
+      break;
+    }
+    if (child + 1 < heap_size_ && heap_[child + 1].key < heap_[child].key) {
+      child++;
+    }
+    if (!(heap_[child].key < e.key)) {
+      break;
+    }
+    heap_set(i, heap_[child]);
+    i = child;
+  }
+  heap_set(i, e);
+}
+
+void GridPlanner::heap_push(uint32_t u, Key key) {
+  HeapEntry e = {key, u};
+  heap_set(heap_size_, e);
+  sift_up(heap_size_++);
+}
+
+void GridPlanner::heap_remove(uint32_t u) {
+  uint32_t i = heap_pos_[u];
+  heap_pos_[u] = -1;
+  if (i == --heap_size_) {
+    return;
+  }
+  uint32_t moved = heap_[heap_size_].node;
+  heap_set(i, heap_[heap_size_]);
+  sift_up(i);
+  sift_down(heap_pos_[moved]);
+}
+
+void GridPlanner::heap_update(uint32_t u, Key key) {
+  uint32_t i = heap_pos_[u];
+  heap_[i].key = key;
+  sift_up(i);
+  sift_down(heap_pos_[u]);
+}
+
+void WaypointFollower::set_path(const Waypoint *path, uint32_t count) {
+  path_.assign(path, path + count);
+  next_ = 0;
+}
+
+std::string WaypointFollower::next_cmd(const Pose &pose) {
+  while (next_ < path_.size() &&
+         std::hypot(path_[next_].x - pose.x, path_[next_].y - pose.y) <
+             reach_distance_) {
+    next_++;
+  }
+  if (next_ >= path_.size()) {
+    return "brake";
+  }
+  double want = std::atan2(path_[next_].y - pose.y, path_[next_].x - pose.x);
+  double err = std::remainder(want - pose.theta, 2 * M_PI);
+  if (err > heading_tolerance_) {
+    return "left";
+  }
+  if (err < -heading_tolerance_) {
+    return "right";
+  }
+  return "forward";
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "grid.h"
+#include "pose.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct Waypoint {
+  double x;
+  double y;
+};
+
+// D* Lite over the occupancy grid, 8-connected. The search runs from the
+// goal towards the car, so when the car moves or a few cells change only
+// the affected part of the previous search is repaired. All per-node state
+// lives in arrays sized to the grid at init(), a replan never allocates.
+class GridPlanner {
+public:
+  GridPlanner(const OccupancyGrid &grid, double robot_radius)
+      : grid_(grid), robot_radius_(robot_radius) {}
+  ~GridPlanner() {}
+  int init();
+  // Starts a fresh search towards the goal.
+  int set_goal(double x, double y);
+  int set_start(double x, double y);
+  // Picks up the cells the grid logged as changed and clears the log.
+  void update_from_grid(OccupancyGrid &grid);
+  // Returns false if there is no path from the start to the goal.
+  bool replan();
+  // Path from the start to the goal, straight runs collapsed to their end.
+  uint32_t waypoints(Waypoint *out, uint32_t max);
+  uint64_t expansions() const { return expansions_; }
+
+private:
+  struct Key {
+    float k1;
+    float k2;
+    bool operator<(const Key &o) const {
+      return k1 < o.k1 || (k1 == o.k1 && k2 < o.k2);
+    }
+  };
+  struct HeapEntry {
+    Key key;
+    uint32_t node;
+  };
+
+  uint32_t id(int32_t cx, int32_t cy) const { return cy * width_ + cx; }
+  bool blocked(uint32_t u) const { return inflated_[u] != 0; }
+  float cost(uint32_t u, uint32_t v, int dir) const;
+  float heuristic(uint32_t a, uint32_t b) const;
+  Key calc_key(uint32_t u) const;
+  uint32_t neighbors(uint32_t u, uint32_t *out, int *dirs) const;
+  float best_rhs(uint32_t u) const;
+  void update_vertex(uint32_t u);
+  void reset_search();
+  void mark_cell(int32_t cx, int32_t cy, bool occupied);
+  // heap with positions tracked per node
+  void heap_push(uint32_t u, Key key);
+  void heap_remove(uint32_t u);
+  void heap_update(uint32_t u, Key key);
+  void sift_up(uint32_t i);
+  void sift_down(uint32_t i);
+  void heap_set(uint32_t i, const HeapEntry &e);
+
+private:
+  const OccupancyGrid &grid_;
+  double robot_radius_;
+  int32_t inflate_{0};
+  uint32_t width_{0};
+  uint32_t height_{0};
+  // node pool
+  std::vector<float> g_;
+  std::vector<float> rhs_;
+  std::vector<int32_t> heap_pos_;
+  // number of occupied cells within robot_radius_ of a node
+  std::vector<uint8_t> inflated_;
+  // occupancy as last seen from the grid
+  std::vector<uint8_t> occupied_;
+  std::vector<HeapEntry> heap_;
+  uint32_t heap_size_{0};
+
+  uint32_t goal_{0};
+  uint32_t start_{0};
+  uint32_t last_start_{0};
+  float km_{0};
+  bool has_goal_{false};
+  uint64_t expansions_{0};
+};
+
+// Turns a waypoint list into the car's command words.
+class WaypointFollower {
+public:
+  WaypointFollower() {}
+  ~WaypointFollower() {}
+  void set_path(const Waypoint *path, uint32_t count);
+  // "brake" once the last waypoint is reached.
+  std::string next_cmd(const Pose &pose);
+
+private:
+  std::vector<Waypoint> path_;
+  uint32_t next_{0};
+  double reach_distance_{0.1};
+  // turn in place above this heading error, drive forward below it
+  double heading_tolerance_{0.35};
+};
@@ -0,0 +1,100 @@
+#include "pool.h"
+
+static thread_local const WorkStealingPool *tls_pool = nullptr;
+static thread_local uint32_t tls_worker = 0;
+
+WorkStealingPool::WorkStealingPool(uint32_t threads) {
+  if (threads == 0) {
+    threads = 1;
+  }
+  for (uint32_t i = 0; i < threads; i++) {
+    queues_.push_back(std::unique_ptr<Queue>(new Queue()));
+  }
+  for (uint32_t i = 0; i < threads; i++) {
+    threads_.push_back(std::thread(&WorkStealingPool::run, this, i));
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  for (size_t i = 0; i < threads_.size(); i++) {
+    threads_[i].join();
+  }
+}
+
+void WorkStealingPool::submit(std::function<void()> task) {
+  uint32_t target = tls_pool == this ? tls_worker
+                                     : next_++ % queues_.size();
+  pending_++;
+  {
+    std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+    queues_[target]->tasks.push_back(std::move(task));
+  }
+  {
+    // pairs with the predicate check in run(), so no wakeup is lost
+    std::lock_guard<std::mutex> lock(mutex_);
+    queued_++;
+  }
+  work_cv_.notify_one();
+}
+
+void WorkStealingPool::wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this] { return pending_ == 0; });
+}
+
+bool WorkStealingPool::pop(uint32_t self, std::function<void()> *task) {
+  Queue &q = *queues_[self];
+  std::lock_guard<std::mutex> lock(q.mutex);
+  if (q.tasks.empty()) {
+    return false;
+  }
+  *task = std::move(q.tasks.back());
+  q.tasks.pop_back();
+  queued_--;
+  return true;
+}
+
+bool WorkStealingPool::steal(uint32_t self, std::function<void()> *task) {
+  uint32_t n = static_cast<uint32_t>(queues_.size());
+  for (uint32_t k = 1; k < n; k++) {
+    Queue &q = *queues_[(self + k) % n];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (!q.tasks.empty()) {
+      *task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+      queued_--;
+      steals_++;
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingPool::run(uint32_t self) {
+  tls_pool = this;
+  tls_worker = self;
+  std::function<void()> task;
+  while (true) {
+    if (pop(self, &task) || steal(self, &task)) {
+      task();
+      task = nullptr;
+      if (--pending_ == 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_cv_.notify_all();
+      }
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    // sleeps until submit() queues a task, a task counted but not taken
+    // yet sends the worker round to look again
+    work_cv_.wait(lock, [this] { return stop_ || queued_ > 0; });
+    if (stop_ && queued_ == 0) {
+      return;
+    }
+  }
+}
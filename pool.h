@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+// Fixed set of workers, each with its own task deque. A worker takes its
+// newest task first and, once it runs dry, steals the oldest task of
+// another worker, so long and short tasks even out across the cores.
+class WorkStealingPool {
+public:
+  explicit WorkStealingPool(uint32_t threads);
+  ~WorkStealingPool();
+  // From a worker the task goes to that worker's own deque, from outside
+  // the deques take turns.
+  void submit(std::function<void()> task);
+  // Blocks until every submitted task has finished.
+  void wait();
+  uint32_t size() const { return static_cast<uint32_t>(threads_.size()); }
+  uint64_t steals() const { return steals_; }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()> > tasks;
+  };
+  void run(uint32_t self);
+  bool pop(uint32_t self, std::function<void()> *task);
+  bool steal(uint32_t self, std::function<void()> *task);
+
+private:
+  std::vector<std::unique_ptr<Queue> > queues_;
+  std::vector<std::thread> threads_;
+  std::atomic<uint32_t> next_{0};
+  std::atomic<uint64_t> pending_{0};
+  // tasks sitting in a deque, raised under mutex_ after the push so a
+  // worker going to sleep either sees the task or gets the notify
+  std::atomic<uint64_t> queued_{0};
+  std::atomic<uint64_t> steals_{0};
+  std::atomic<bool> stop_{false};
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+};
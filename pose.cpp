@@ -0,0 +1,41 @@
+#include "pose.h"
+#include <algorithm>
+#include <cmath>
+
+void DeadReckoning::advance(uint64_t now_ns) {
+  if (last_ns_ == 0 || now_ns <= last_ns_) {
+    last_ns_ = now_ns;
+    return;
+  }
+  double dt = std::min(DEAD_RECKONING_MAX_DT, (now_ns - last_ns_) / 1e9);
+  last_ns_ = now_ns;
+  if (motion_ == 1 || motion_ == -1) {
+    double d = motion_ * speed_ * mps_per_duty_ * dt;
+    pose_.x += d * std::cos(pose_.theta);
+    pose_.y += d * std::sin(pose_.theta);
+  } else if (motion_ == 2 || motion_ == -2) {
+    pose_.theta += (motion_ / 2) * turn_rate_dps_ * M_PI / 180 * dt;
+    pose_.theta = std::remainder(pose_.theta, 2 * M_PI);
+  }
+}
+
+void DeadReckoning::reset(const Pose &pose) {
+  pose_ = pose;
+  motion_ = 0;
+  last_ns_ = 0;
+}
+
+void DeadReckoning::set_cmd(const std::string &cmd, uint32_t speed) {
+  speed_ = speed;
+  if (cmd == "forward") {
+    motion_ = 1;
+  } else if (cmd == "backward") {
+    motion_ = -1;
+  } else if (cmd == "left") {
+    motion_ = 2;
+  } else if (cmd == "right") {
+    motion_ = -2;
+  } else {
+    motion_ = 0;
+  }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+
+// the longest step advance() integrates, two loop ticks: after a longer
+// gap nobody knows what the car did in between
+#define DEAD_RECKONING_MAX_DT 0.2 /*s*/
+
+// Position in meters and heading in radians, counter-clockwise positive, in
+// the frame of the map, see OccupancyGrid::saved_pose().
+struct Pose {
+  double x;
+  double y;
+  double theta;
+};
+
+// Pose estimate integrated from the commands sent to the car. There are no
+// wheel encoders, so speeds come from calibration constants.
+class DeadReckoning {
+public:
+  DeadReckoning(double turn_rate_dps) : turn_rate_dps_(turn_rate_dps) {
+    pose_.x = 0;
+    pose_.y = 0;
+    pose_.theta = 0;
+  }
+  ~DeadReckoning() {}
+  // Applies the motion of the command that ran since the last call, at
+  // most DEAD_RECKONING_MAX_DT of it.
+  void advance(uint64_t now_ns);
+  // Starts over at pose, standing still.
+  void reset(const Pose &pose);
+  // Records the command the car is running from now on.
+  void set_cmd(const std::string &cmd, uint32_t speed);
+  const Pose &pose() const { return pose_; }
+
+private:
+  Pose pose_;
+  double turn_rate_dps_;
+  // ground speed per percent of forward duty
+  double mps_per_duty_{0.008};
+  // 0 stop, 1 forward, -1 backward, 2 turn left, -2 turn right
+  int motion_{0};
+  uint32_t speed_{0};
+  uint64_t last_ns_{0};
+};
@@ -0,0 +1,128 @@
+// Checks the register stores of the RP1 backend against a file standing in
+// for /dev/gpiomem0. A file is no register block: the SET and CLR aliases
+// just keep the last word stored, and that word is what gets checked, so a
+// store per pin instead of one per write shows up as missing bits.
+#include "rp1_gpio.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+extern "C" {
+#include "lgpio.h"
+}
+
+static volatile uint32_t *regs;
+static int failed = 0;
+
+static uint32_t word(uint32_t offset) { return regs[offset / 4]; }
+
+static void clear_aliases() {
+  for (uint32_t alias : {RP1_SET, RP1_CLR}) {
+    for (uint32_t r : {RP1_RIO_OUT, RP1_RIO_OE}) {
+      regs[(RP1_SYS_RIO0 + alias + r) / 4] = 0;
+    }
+  }
+}
+
+static void expect(const char *what, uint32_t got, uint32_t want) {
+  if (got != want) {
+    printf("FAIL: %s is 0x%08x, not 0x%08x\n", what, got, want);
+    failed++;
+  }
+}
+
+int main() {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/toy_car_rp1_check.%d", getpid());
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0 || ftruncate(fd, RP1_MAP_SIZE)) {
+    printf("FAIL: cannot make %s\n", path);
+    return 1;
+  }
+  void *p = mmap(nullptr, RP1_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    printf("FAIL: cannot map %s\n", path);
+    unlink(path);
+    return 1;
+  }
+  regs = static_cast<volatile uint32_t *>(p);
+  Rp1Gpio gpio;
+  if (gpio.open(path)) {
+    printf("FAIL: Rp1Gpio cannot open %s\n", path);
+    unlink(path);
+    return 1;
+  }
+
+  // a pin left on another function, with bits outside FUNCSEL set
+  regs[(RP1_IO_BANK0 + RP1_CTRL(17)) / 4] = 0x3000 | RP1_FUNCSEL_MASK;
+  regs[(RP1_PADS_BANK0 + RP1_PAD(17)) / 4] = RP1_PAD_OD;
+  expect("claim_output(17)", gpio.claim_output(0, 17, 0), 0);
+  expect("GPIO17_CTRL", word(RP1_IO_BANK0 + RP1_CTRL(17)),
+         0x3000 | RP1_FUNCSEL_RIO);
+  expect("RIO OE SET after claim_output",
+         word(RP1_SYS_RIO0 + RP1_SET + RP1_RIO_OE), 1u << 17);
+  expect("RIO OUT CLR after claim_output low",
+         word(RP1_SYS_RIO0 + RP1_CLR + RP1_RIO_OUT), 1u << 17);
+  expect("GPIO17 pad", word(RP1_PADS_BANK0 + RP1_PAD(17)), RP1_PAD_IE);
+
+  clear_aliases();
+  expect("write(17, 1)", gpio.write(0, 17, 1), 0);
+  expect("RIO OUT SET after write high",
+         word(RP1_SYS_RIO0 + RP1_SET + RP1_RIO_OUT), 1u << 17);
+  expect("RIO OUT CLR after write high",
+         word(RP1_SYS_RIO0 + RP1_CLR + RP1_RIO_OUT), 0);
+  clear_aliases();
+  expect("write(17, 0)", gpio.write(0, 17, 0), 0);
+  expect("RIO OUT CLR after write low",
+         word(RP1_SYS_RIO0 + RP1_CLR + RP1_RIO_OUT), 1u << 17);
+  expect("RIO OUT SET after write low",
+         word(RP1_SYS_RIO0 + RP1_SET + RP1_RIO_OUT), 0);
+
+  // the motor pins of one side, as Car claims them
+  static const int pins[4] = {23, 24, 5, 6};
+  static const int levels[4] = {0, 0, 0, 0};
+  expect("claim_group(23, 24, 5, 6)",
+         gpio.claim_group(0, 4, pins, 0, levels), 0);
+  clear_aliases();
+  expect("group_write", gpio.group_write(0, 23, 0x5, 0xf), 0);
+  expect("RIO OUT SET after group_write",
+         word(RP1_SYS_RIO0 + RP1_SET + RP1_RIO_OUT), 1u << 23 | 1u << 5);
+  expect("RIO OUT CLR after group_write",
+         word(RP1_SYS_RIO0 + RP1_CLR + RP1_RIO_OUT), 1u << 24 | 1u << 6);
+  clear_aliases();
+  expect("masked group_write", gpio.group_write(0, 23, 0x1, 0x3), 0);
+  expect("RIO OUT SET after masked group_write",
+         word(RP1_SYS_RIO0 + RP1_SET + RP1_RIO_OUT), 1u << 23);
+  expect("RIO OUT CLR after masked group_write",
+         word(RP1_SYS_RIO0 + RP1_CLR + RP1_RIO_OUT), 1u << 24);
+
+  clear_aliases();
+  expect("claim_input(25)", gpio.claim_input(0, 25, LG_SET_PULL_UP), 0);
+  expect("RIO OE CLR after claim_input",
+         word(RP1_SYS_RIO0 + RP1_CLR + RP1_RIO_OE), 1u << 25);
+  expect("GPIO25 pad", word(RP1_PADS_BANK0 + RP1_PAD(25)),
+         RP1_PAD_IE | RP1_PAD_PUE);
+  regs[(RP1_SYS_RIO0 + RP1_RIO_SYNC_IN) / 4] = 1u << 25;
+  expect("read(25)", gpio.read(0, 25), 1);
+
+  // a group with a pin of another handle claims none of its pins
+  expect("claim_output(8) by another handle", gpio.claim_output(1, 8, 0), 0);
+  static const int busy[2] = {7, 8};
+  expect("claim_group(7, 8) with 8 taken",
+         gpio.claim_group(0, 2, busy, 0, levels),
+         static_cast<uint32_t>(LG_GPIO_BUSY));
+  expect("claim_output(7) after the failed group", gpio.claim_output(1, 7, 0),
+         0);
+
+  gpio.close();
+  munmap(const_cast<uint32_t *>(regs), RP1_MAP_SIZE);
+  unlink(path);
+  if (failed) {
+    return 1;
+  }
+  printf("rp1 registers as expected\n");
+  return 0;
+}
@@ -0,0 +1,361 @@
+#include "rp1_gpio.h"
+extern "C" {
+#include "lgpio.h"
+}
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+Rp1Gpio::~Rp1Gpio() { close(); }
+
+int Rp1Gpio::open(const std::string &path) {
+  if (base_) {
+    return 0;
+  }
+  fd_ = ::open(path.c_str(), O_RDWR | O_SYNC | O_CLOEXEC);
+  if (fd_ < 0) {
+    return -1;
+  }
+  struct stat st;
+  // the device node has no size, a stand-in file must cover every block
+  if (fstat(fd_, &st) || (S_ISREG(st.st_mode) && st.st_size < RP1_MAP_SIZE)) {
+    ::close(fd_);
+    fd_ = -1;
+    return -1;
+  }
+  void *p = mmap(nullptr, RP1_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 fd_, 0);
+  if (p == MAP_FAILED) {
+    ::close(fd_);
+    fd_ = -1;
+    return -1;
+  }
+  base_ = static_cast<volatile uint32_t *>(p);
+  for (int i = 0; i < RP1_GPIO_COUNT; i++) {
+    owner_[i] = -1;
+    output_[i] = false;
+    group_size_[i] = 0;
+  }
+  return 0;
+}
+
+void Rp1Gpio::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+  changed_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  pulse_mask_ = 0;
+  if (base_) {
+    munmap(const_cast<uint32_t *>(base_), RP1_MAP_SIZE);
+    base_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+bool Rp1Gpio::owns(int handle, int gpio) const {
+  return base_ && gpio >= 0 && gpio < RP1_GPIO_COUNT &&
+         owner_[gpio] == handle;
+}
+
+int Rp1Gpio::claim_input(int handle, int gpio, int flags) {
+  if (!base_ || gpio < 0 || gpio >= RP1_GPIO_COUNT) {
+    return LG_BAD_GPIO_NUMBER;
+  }
+  if (owner_[gpio] >= 0 && owner_[gpio] != handle) {
+    return LG_GPIO_BUSY;
+  }
+  stop_pulse(gpio);
+  owner_[gpio] = handle;
+  output_[gpio] = false;
+  *reg(RP1_SYS_RIO0 + RP1_CLR + RP1_RIO_OE) = 1u << gpio;
+  uint32_t pad = *reg(RP1_PADS_BANK0 + RP1_PAD(gpio));
+  pad &= ~(RP1_PAD_OD | RP1_PAD_PUE | RP1_PAD_PDE);
+  pad |= RP1_PAD_IE;
+  if (flags & LG_SET_PULL_UP) {
+    pad |= RP1_PAD_PUE;
+  } else if (flags & LG_SET_PULL_DOWN) {
+    pad |= RP1_PAD_PDE;
+  }
+  *reg(RP1_PADS_BANK0 + RP1_PAD(gpio)) = pad;
+  uint32_t ctrl = *reg(RP1_IO_BANK0 + RP1_CTRL(gpio));
+  *reg(RP1_IO_BANK0 + RP1_CTRL(gpio)) =
+      (ctrl & ~RP1_FUNCSEL_MASK) | RP1_FUNCSEL_RIO;
+  return 0;
+}
+
+int Rp1Gpio::claim_output(int handle, int gpio, int level) {
+  if (!base_ || gpio < 0 || gpio >= RP1_GPIO_COUNT) {
+    return LG_BAD_GPIO_NUMBER;
+  }
+  if (owner_[gpio] >= 0 && owner_[gpio] != handle) {
+    return LG_GPIO_BUSY;
+  }
+  stop_pulse(gpio);
+  owner_[gpio] = handle;
+  output_[gpio] = true;
+  // level first, so the pin never drives the old value
+  *reg(RP1_SYS_RIO0 + (level ? RP1_SET : RP1_CLR) + RP1_RIO_OUT) = 1u << gpio;
+  *reg(RP1_SYS_RIO0 + RP1_SET + RP1_RIO_OE) = 1u << gpio;
+  uint32_t pad = *reg(RP1_PADS_BANK0 + RP1_PAD(gpio));
+  *reg(RP1_PADS_BANK0 + RP1_PAD(gpio)) = (pad & ~RP1_PAD_OD) | RP1_PAD_IE;
+  uint32_t ctrl = *reg(RP1_IO_BANK0 + RP1_CTRL(gpio));
+  *reg(RP1_IO_BANK0 + RP1_CTRL(gpio)) =
+      (ctrl & ~RP1_FUNCSEL_MASK) | RP1_FUNCSEL_RIO;
+  return 0;
+}
+
+int Rp1Gpio::release(int handle, int gpio) {
+  if (!owns(handle, gpio)) {
+    return LG_GPIO_NOT_ALLOCATED;
+  }
+  stop_pulse(gpio);
+  // back to a plain input, like lgpio leaves it
+  *reg(RP1_SYS_RIO0 + RP1_CLR + RP1_RIO_OE) = 1u << gpio;
+  owner_[gpio] = -1;
+  output_[gpio] = false;
+  return 0;
+}
+
+int Rp1Gpio::read(int handle, int gpio) const {
+  if (!owns(handle, gpio)) {
+    return LG_GPIO_NOT_ALLOCATED;
+  }
+  return (*reg(RP1_SYS_RIO0 + RP1_RIO_SYNC_IN) >> gpio) & 1;
+}
+
+int Rp1Gpio::write(int handle, int gpio, int level) {
+  if (!owns(handle, gpio)) {
+    return LG_GPIO_NOT_ALLOCATED;
+  }
+  if (!output_[gpio]) {
+    return LG_NOT_PERMITTED;
+  }
+  // a plain write ends any pulses on the pin
+  if (pulse_mask_.load(std::memory_order_relaxed) & (1u << gpio)) {
+    stop_pulse(gpio);
+  }
+  *reg(RP1_SYS_RIO0 + (level ? RP1_SET : RP1_CLR) + RP1_RIO_OUT) = 1u << gpio;
+  return 0;
+}
+
+int Rp1Gpio::pwm(int handle, int gpio, float freq, float duty) {
+  if (!owns(handle, gpio)) {
+    return LG_GPIO_NOT_ALLOCATED;
+  }
+  if (freq < 0 || freq > 10000) {
+    return LG_BAD_PWM_FREQ;
+  }
+  if (duty < 0 || duty > 100) {
+    return LG_BAD_PWM_DUTY;
+  }
+  if (freq == 0 || duty == 0) {
+    stop_pulse(gpio);
+    return 0;
+  }
+  uint64_t period = static_cast<uint64_t>(1e9 / freq);
+  return pulse(handle, gpio, period,
+               static_cast<uint64_t>(period * (duty / 100.0)));
+}
+
+int Rp1Gpio::servo(int handle, int gpio, int pulse_us, int freq) {
+  if (!owns(handle, gpio)) {
+    return LG_GPIO_NOT_ALLOCATED;
+  }
+  if (freq < 40 || freq > 10000) {
+    return LG_BAD_SERVO_FREQ;
+  }
+  if (pulse_us < 0 || static_cast<uint64_t>(pulse_us) * freq > 1000000) {
+    return LG_BAD_SERVO_WIDTH;
+  }
+  if (pulse_us == 0) {
+    stop_pulse(gpio);
+    return 0;
+  }
+  return pulse(handle, gpio, 1000000000ULL / freq, pulse_us * 1000ULL);
+}
+
+int Rp1Gpio::claim_group(int handle, int count, const int *gpios, int flags,
+                         const int *levels) {
+  if (!base_ || count <= 0 || count > RP1_GPIO_COUNT) {
+    return LG_BAD_GROUP_SIZE;
+  }
+  bool had[RP1_GPIO_COUNT];
+  for (int i = 0; i < count; i++) {
+    if (gpios[i] < 0 || gpios[i] >= RP1_GPIO_COUNT) {
+      return LG_BAD_GPIO_NUMBER;
+    }
+    if (owner_[gpios[i]] >= 0 && owner_[gpios[i]] != handle) {
+      return LG_GPIO_BUSY;
+    }
+    had[i] = owner_[gpios[i]] == handle;
+  }
+  for (int i = 0; i < count; i++) {
+    int rc = levels ? claim_output(handle, gpios[i], levels[i])
+                    : claim_input(handle, gpios[i], flags);
+    if (rc) {
+      // all or nothing, give back what this call claimed
+      for (int k = 0; k < i; k++) {
+        if (!had[k]) {
+          release(handle, gpios[k]);
+        }
+      }
+      return rc;
+    }
+    group_[gpios[0]][i] = static_cast<uint8_t>(gpios[i]);
+  }
+  group_size_[gpios[0]] = static_cast<uint8_t>(count);
+  return 0;
+}
+
+int Rp1Gpio::release_group(int handle, int leader) {
+  if (!owns(handle, leader) || group_size_[leader] == 0) {
+    return LG_NOT_GROUP_LEADER;
+  }
+  for (int i = 0; i < group_size_[leader]; i++) {
+    release(handle, group_[leader][i]);
+  }
+  group_size_[leader] = 0;
+  return 0;
+}
+
+int Rp1Gpio::group_write(int handle, int leader, uint64_t bits,
+                         uint64_t mask) {
+  if (!owns(handle, leader) || group_size_[leader] == 0) {
+    return LG_NOT_GROUP_LEADER;
+  }
+  uint32_t set = 0;
+  uint32_t clr = 0;
+  for (int i = 0; i < group_size_[leader]; i++) {
+    if (mask >> i & 1) {
+      uint32_t pin = 1u << group_[leader][i];
+      if (bits >> i & 1) {
+        set |= pin;
+      } else {
+        clr |= pin;
+      }
+    }
+  }
+  if (pulse_mask_.load(std::memory_order_relaxed) & (set | clr)) {
+    for (int i = 0; i < RP1_GPIO_COUNT; i++) {
+      if ((set | clr) & (1u << i)) {
+        stop_pulse(i);
+      }
+    }
+  }
+  if (clr) {
+    *reg(RP1_SYS_RIO0 + RP1_CLR + RP1_RIO_OUT) = clr;
+  }
+  if (set) {
+    *reg(RP1_SYS_RIO0 + RP1_SET + RP1_RIO_OUT) = set;
+  }
+  return 0;
+}
+
+int Rp1Gpio::group_read(int handle, int leader, uint64_t *bits) const {
+  if (!owns(handle, leader) || group_size_[leader] == 0) {
+    return LG_NOT_GROUP_LEADER;
+  }
+  uint32_t in = *reg(RP1_SYS_RIO0 + RP1_RIO_SYNC_IN);
+  *bits = 0;
+  for (int i = 0; i < group_size_[leader]; i++) {
+    *bits |= static_cast<uint64_t>(in >> group_[leader][i] & 1) << i;
+  }
+  return group_size_[leader];
+}
+
+int Rp1Gpio::pulse(int handle, int gpio, uint64_t period_ns,
+                   uint64_t high_ns) {
+  if (!output_[gpio]) {
+    return LG_NOT_PERMITTED;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Pulse &p = pulse_[gpio];
+    bool running = pulse_mask_ & (1u << gpio);
+    p.period_ns = period_ns;
+    p.high_ns = std::min(high_ns, period_ns);
+    // a running pin keeps its phase, a new one starts right away
+    if (!running) {
+      p.next_rise = now_ns();
+      p.next_fall = UINT64_MAX;
+    }
+    pulse_mask_ |= 1u << gpio;
+    if (!running_) {
+      running_ = true;
+      thread_ = std::thread(&Rp1Gpio::run_pulses, this);
+    }
+  }
+  changed_.notify_all();
+  return 0;
+}
+
+void Rp1Gpio::stop_pulse(int gpio) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!(pulse_mask_ & (1u << gpio))) {
+      return;
+    }
+    pulse_mask_ &= ~(1u << gpio);
+    *reg(RP1_SYS_RIO0 + RP1_CLR + RP1_RIO_OUT) = 1u << gpio;
+  }
+  changed_.notify_all();
+}
+
+void Rp1Gpio::run_pulses() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_) {
+    uint64_t now = now_ns();
+    uint64_t wake = now + 1000000000ULL;
+    uint32_t set = 0;
+    uint32_t clr = 0;
+    uint32_t mask = pulse_mask_;
+    for (int i = 0; i < RP1_GPIO_COUNT; i++) {
+      if (!(mask & (1u << i))) {
+        continue;
+      }
+      Pulse &p = pulse_[i];
+      if (now >= p.next_fall) {
+        clr |= 1u << i;
+        p.next_fall = UINT64_MAX;
+      }
+      if (now >= p.next_rise) {
+        set |= 1u << i;
+        clr &= ~(1u << i);
+        if (p.high_ns < p.period_ns) {
+          p.next_fall = p.next_rise + p.high_ns;
+        }
+        p.next_rise += p.period_ns;
+        // woke up late, skip the periods that are gone
+        if (p.next_rise <= now) {
+          p.next_rise = now + p.period_ns;
+        }
+      }
+      wake = std::min(wake, std::min(p.next_rise, p.next_fall));
+    }
+    // all edges due now in two stores
+    if (clr) {
+      *reg(RP1_SYS_RIO0 + RP1_CLR + RP1_RIO_OUT) = clr;
+    }
+    if (set) {
+      *reg(RP1_SYS_RIO0 + RP1_SET + RP1_RIO_OUT) = set;
+    }
+    changed_.wait_until(lock, std::chrono::steady_clock::time_point(
+                                  std::chrono::nanoseconds(wake)));
+  }
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+// RP1 bank 0 as mapped by /dev/gpiomem0 on the Pi 5
+#define RP1_GPIO_COUNT 28
+#define RP1_IO_BANK0 0x00000
+#define RP1_SYS_RIO0 0x10000
+#define RP1_PADS_BANK0 0x20000
+#define RP1_MAP_SIZE 0x30000
+// atomic aliases of every register block
+#define RP1_SET 0x2000
+#define RP1_CLR 0x3000
+// SYS_RIO registers
+#define RP1_RIO_OUT 0x00
+#define RP1_RIO_OE 0x04
+#define RP1_RIO_SYNC_IN 0x08
+// IO_BANK0 GPIOn_CTRL, function 5 hands the pin to SYS_RIO
+#define RP1_CTRL(n) ((n) * 8 + 4)
+#define RP1_FUNCSEL_MASK 0x1f
+#define RP1_FUNCSEL_RIO 5
+// PADS_BANK0 GPIOn
+#define RP1_PAD(n) (0x04 + (n) * 4)
+#define RP1_PAD_OD (1 << 7)
+#define RP1_PAD_IE (1 << 6)
+#define RP1_PAD_PUE (1 << 3)
+#define RP1_PAD_PDE (1 << 2)
+
+// GPIO through the RP1 registers instead of the gpiochip ioctls: a read or
+// a write is one load or store. Pins are owned by the handle that claimed
+// them. lgpio drives PWM and servo pulses from a thread, so does this.
+// Any file of RP1_MAP_SIZE bytes can stand in for the register block.
+class Rp1Gpio {
+public:
+  Rp1Gpio() {}
+  ~Rp1Gpio();
+  int open(const std::string &path);
+  void close();
+  bool is_open() const { return base_ != nullptr; }
+
+  // Claims happen at startup. Reads and writes are lock free and can come
+  // from any thread. flags take LG_SET_PULL_UP/DOWN/NONE, results are lgpio
+  // error codes.
+  int claim_input(int handle, int gpio, int flags);
+  int claim_output(int handle, int gpio, int level);
+  int release(int handle, int gpio);
+  int read(int handle, int gpio) const;
+  int write(int handle, int gpio, int level);
+  // duty in percent, a 0 frequency or duty stops the pulses
+  int pwm(int handle, int gpio, float freq, float duty);
+  // pulse width in microseconds, 0 stops the pulses
+  int servo(int handle, int gpio, int pulse_us, int freq);
+  // Groups are named by their first gpio, bit i is gpios[i]. A group write
+  // is one store to SET and one to CLR.
+  int claim_group(int handle, int count, const int *gpios, int flags,
+                  const int *levels);
+  int release_group(int handle, int leader);
+  int group_write(int handle, int leader, uint64_t bits, uint64_t mask);
+  int group_read(int handle, int leader, uint64_t *bits) const;
+
+private:
+  volatile uint32_t *reg(uint32_t offset) const {
+    return base_ + offset / 4;
+  }
+  bool owns(int handle, int gpio) const;
+  int pulse(int handle, int gpio, uint64_t period_ns, uint64_t high_ns);
+  void stop_pulse(int gpio);
+  void run_pulses();
+
+private:
+  volatile uint32_t *base_{nullptr};
+  int fd_{-1};
+  int owner_[RP1_GPIO_COUNT];
+  bool output_[RP1_GPIO_COUNT];
+  uint8_t group_size_[RP1_GPIO_COUNT];
+  uint8_t group_[RP1_GPIO_COUNT][RP1_GPIO_COUNT];
+  // software pulses, guarded by mutex_
+  struct Pulse {
+    uint64_t period_ns;
+    uint64_t high_ns;
+    uint64_t next_rise;
+    uint64_t next_fall;
+  };
+  Pulse pulse_[RP1_GPIO_COUNT];
+  std::atomic<uint32_t> pulse_mask_{0};
+  mutable std::mutex mutex_;
+  std::condition_variable changed_;
+  std::thread thread_;
+  bool running_{false};
+};
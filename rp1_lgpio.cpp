@@ -0,0 +1,110 @@
+// The parts of lgpio the car uses, on the RP1 registers of a Pi 5 mapped
+// from /dev/gpiomem0. TOY_CAR_GPIOMEM points it at another file, e.g. a
+// stand-in for the register block. Link it instead of -llgpio.
+#include "rp1_gpio.h"
+#include <cstdlib>
+#include <errno.h>
+#include <time.h>
+extern "C" {
+#include "lgpio.h"
+}
+
+static Rp1Gpio rp1;
+static std::mutex open_mutex;
+static int next_handle = 0;
+
+extern "C" {
+
+extern const char *const toy_gpio_backend_name = "rp1";
+
+int lgGpiochipOpen(int gpioDev) {
+  std::lock_guard<std::mutex> lock(open_mutex);
+  if (!rp1.is_open()) {
+    const char *path = getenv("TOY_CAR_GPIOMEM");
+    if (rp1.open(path && *path ? path : "/dev/gpiomem0")) {
+      return LG_CANNOT_OPEN_CHIP;
+    }
+  }
+  return next_handle++;
+}
+
+int lgGpiochipClose(int handle) { return 0; }
+
+int lgGpioClaimInput(int handle, int lFlags, int gpio) {
+  return rp1.claim_input(handle, gpio, lFlags);
+}
+
+int lgGpioClaimOutput(int handle, int lFlags, int gpio, int level) {
+  return rp1.claim_output(handle, gpio, level);
+}
+
+int lgGpioFree(int handle, int gpio) { return rp1.release(handle, gpio); }
+
+int lgGpioRead(int handle, int gpio) { return rp1.read(handle, gpio); }
+
+int lgGpioWrite(int handle, int gpio, int level) {
+  return rp1.write(handle, gpio, level);
+}
+
+int lgGroupClaimInput(int handle, int lFlags, int count, const int *gpios) {
+  return rp1.claim_group(handle, count, gpios, lFlags, nullptr);
+}
+
+int lgGroupClaimOutput(int handle, int lFlags, int count, const int *gpios,
+                       const int *levels) {
+  return rp1.claim_group(handle, count, gpios, lFlags, levels);
+}
+
+int lgGroupFree(int handle, int gpio) {
+  return rp1.release_group(handle, gpio);
+}
+
+int lgGroupRead(int handle, int gpio, uint64_t *groupBits) {
+  return rp1.group_read(handle, gpio, groupBits);
+}
+
+int lgGroupWrite(int handle, int gpio, uint64_t groupBits,
+                 uint64_t groupMask) {
+  return rp1.group_write(handle, gpio, groupBits, groupMask);
+}
+
+// edges would need the gpiochip interrupts this backend bypasses
+int lgGpioClaimAlert(int handle, int lFlags, int eFlags, int gpio,
+                     int nfyHandle) {
+  return LG_NOT_PERMITTED;
+}
+
+int lgGpioSetAlertsFunc(int handle, int gpio, lgGpioAlertsFunc_t cbf,
+                        void *userdata) {
+  return LG_NOT_PERMITTED;
+}
+
+int lgTxPwm(int handle, int gpio, float pwmFrequency, float pwmDutyCycle,
+            int pwmOffset, int pwmCycles) {
+  return rp1.pwm(handle, gpio, pwmFrequency, pwmDutyCycle);
+}
+
+int lgTxServo(int handle, int gpio, int pulseWidth, int servoFrequency,
+              int servoOffset, int servoCycles) {
+  return rp1.servo(handle, gpio, pulseWidth, servoFrequency);
+}
+
+uint64_t lguTimestamp(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+double lguTime(void) { return lguTimestamp() / 1e9; }
+
+void lguSleep(double sleepSecs) {
+  if (sleepSecs <= 0) {
+    return;
+  }
+  struct timespec ts;
+  ts.tv_sec = static_cast<time_t>(sleepSecs);
+  ts.tv_nsec = static_cast<long>((sleepSecs - ts.tv_sec) * 1e9);
+  while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+  }
+}
+}
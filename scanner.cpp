@@ -0,0 +1,129 @@
+#include "scanner.h"
+extern "C" {
+#include "lgpio.h"
+}
+#include <algorithm>
+#include <cmath>
+
+#define SERVO_FREQ_HZ 50
+
+PanScanner::PanScanner(Sonar *sonar, uint32_t servo)
+    : sonar_(sonar), servo_(servo) {
+  io_handle_ = lgGpiochipOpen(4);
+  lgGpioClaimOutput(io_handle_, 0, servo_, 0);
+  latest_.seq = 0;
+  latest_.stamp = 0;
+  latest_.count = 0;
+  // the servo may be anywhere, a whole range away at worst
+  pointed_deg_ = 180;
+  center();
+}
+
+PanScanner::~PanScanner() {
+  stop();
+  lgTxServo(io_handle_, servo_, 0, SERVO_FREQ_HZ, 0, 0);
+}
+
+int PanScanner::start() {
+  if (running_) {
+    return 0;
+  }
+  if (steps_ > SCANNER_MAX_STEPS) {
+    return -1;
+  }
+  running_ = true;
+  thread_ = std::thread(&PanScanner::run, this);
+  return 0;
+}
+
+void PanScanner::stop() {
+  cancel_ = true;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  running_ = false;
+  cancel_ = false;
+}
+
+bool PanScanner::snapshot(ScanProfile *profile) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (latest_.seq == 0) {
+    return false;
+  }
+  *profile = latest_;
+  return true;
+}
+
+void PanScanner::point(double angle_deg) {
+  // 500us..2500us covers -90..90 degrees
+  int width = 1500 + static_cast<int>(angle_deg * 1000 / 90);
+  lgTxServo(io_handle_, servo_, width, SERVO_FREQ_HZ, 0, 0);
+  pointed_deg_ = angle_deg;
+}
+
+void PanScanner::center() {
+  double move = std::fabs(pointed_deg_);
+  point(0);
+  lguSleep(move * settle_ns_per_deg_ / 1e9);
+}
+
+bool PanScanner::sweep(ScanProfile *profile) {
+  if (steps_ > SCANNER_MAX_STEPS) {
+    return false;
+  }
+  // sweep back from where the servo is, it does not have to fly back
+  bool reverse = pointed_deg_ > min_deg_ + (steps_ - 1) * step_deg_ / 2;
+  uint32_t first = reverse ? steps_ - 1 : 0;
+  double first_deg = min_deg_ + first * step_deg_;
+  uint64_t settle =
+      static_cast<uint64_t>(std::fabs(first_deg - pointed_deg_) *
+                            settle_ns_per_deg_);
+  point(first_deg);
+  uint64_t next_ping = lguTimestamp() + settle;
+  for (uint32_t k = 0; k < steps_; k++) {
+    if (cancel_) {
+      return false;
+    }
+    uint32_t i = reverse ? steps_ - 1 - k : k;
+    uint64_t now = lguTimestamp();
+    if (now < next_ping) {
+      lguSleep((next_ping - now) / 1e9);
+    }
+    uint64_t ping_start = lguTimestamp();
+    double distance = sonar_->get_distance();
+    uint64_t echo_end = lguTimestamp();
+
+    // 回波一回来就转向下一个角度，舵机转动和两次测距之间的静默期重叠，
+    // 每个角度只花一次回波飞行的时间
+    settle = 0;
+    if (k + 1 < steps_) {
+      uint32_t next = reverse ? i - 1 : i + 1;
+      point(min_deg_ + next * step_deg_);
+      settle = static_cast<uint64_t>(step_deg_ * settle_ns_per_deg_);
+    }
+    next_ping = std::max(echo_end + settle, ping_start + min_cycle_ns_);
+
+    profile->angle_deg[i] = min_deg_ + i * step_deg_;
+    profile->range_m[i] = distance;
+  }
+  // the last echo dies down before anyone pings again
+  uint64_t now = lguTimestamp();
+  if (now < next_ping) {
+    lguSleep((next_ping - now) / 1e9);
+  }
+  profile->seq = ++seq_;
+  profile->stamp = lguTimestamp();
+  profile->count = steps_;
+  return true;
+}
+
+void PanScanner::run() {
+  ScanProfile profile;
+  while (!cancel_) {
+    if (!sweep(&profile)) {
+      break;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    latest_ = profile;
+  }
+}
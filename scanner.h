@@ -0,0 +1,66 @@
+#pragma once
+#include "sonar.h"
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+
+#define SCANNER_MAX_STEPS 64
+
+// One full sweep of the panning sonar. Angles are in degrees, 0 is straight
+// ahead and positive is to the right.
+struct ScanProfile {
+  uint32_t seq;
+  uint64_t stamp;
+  uint32_t count;
+  float angle_deg[SCANNER_MAX_STEPS];
+  float range_m[SCANNER_MAX_STEPS];
+};
+
+// Sonar mounted on a servo. sweep() pans it across once on the calling
+// thread; start() does that over and over from a thread of its own and
+// publishes every completed sweep as a snapshot. The sonar stays its
+// owner's, whoever else pings it must not while a sweep runs.
+class PanScanner {
+public:
+  PanScanner(Sonar *sonar, uint32_t servo);
+  ~PanScanner();
+  // One sweep from the end the servo is nearer to, each angle costs one
+  // echo flight. Returns false if stop() cut it short.
+  bool sweep(ScanProfile *profile);
+  // Points the sonar straight ahead and waits for the servo to get there.
+  void center();
+  int start();
+  void stop();
+  // Copies the latest complete sweep. Returns false before the first one.
+  bool snapshot(ScanProfile *profile);
+  uint32_t steps() const { return steps_; }
+  // the shortest time one angle of a sweep can take
+  uint64_t min_cycle_ns() const { return min_cycle_ns_; }
+
+private:
+  void run();
+  void point(double angle_deg);
+
+private:
+  Sonar *sonar_;
+  int32_t io_handle_;
+  uint32_t servo_;
+  double min_deg_{-90};
+  double step_deg_{5};
+  uint32_t steps_{37};
+  // servo moving speed, SG90 needs about 0.1s per 60 degrees
+  uint64_t settle_ns_per_deg_{1700000};
+  // echo flight for the 4 meters max range, also keeps pings from hearing
+  // the previous ping's echo
+  uint64_t min_cycle_ns_{25000000};
+  // where the servo was last sent
+  double pointed_deg_{0};
+  uint32_t seq_{0};
+
+  std::atomic<bool> running_{false};
+  std::atomic<bool> cancel_{false};
+  std::thread thread_;
+  std::mutex mutex_;
+  ScanProfile latest_;
+};
@@ -0,0 +1,816 @@
+#include "sim.h"
+#include "arena.h"
+#include "car.h"
+#include "cmd_ring.h"
+#include "control.h"
+#include "deadline.h"
+#include "dispatch.h"
+#include "grid.h"
+#include "joystick.h"
+#include "planner.h"
+#include "sonar.h"
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SPEED_OF_SOUND 343.2 /*m/s*/
+
+static thread_local Simulation *tls_sim = nullptr;
+
+void SimWorld::add_polygon(const double *xy, uint32_t points) {
+  for (uint32_t i = 0; i < points; i++) {
+    uint32_t j = (i + 1) % points;
+    SimSegment s = {xy[2 * i], xy[2 * i + 1], xy[2 * j], xy[2 * j + 1]};
+    segments_.push_back(s);
+  }
+}
+
+void SimWorld::add_box(double x, double y, double w, double h) {
+  double xy[8] = {x, y, x + w, y, x + w, y + h, x, y + h};
+  add_polygon(xy, 4);
+}
+
+void SimWorld::build_index(double cell) {
+  cell_ = cell;
+  double max_x = -std::numeric_limits<double>::infinity();
+  double max_y = max_x;
+  min_x_ = std::numeric_limits<double>::infinity();
+  min_y_ = min_x_;
+  for (size_t i = 0; i < segments_.size(); i++) {
+    const SimSegment &s = segments_[i];
+    min_x_ = std::min(min_x_, std::min(s.x1, s.x2));
+    min_y_ = std::min(min_y_, std::min(s.y1, s.y2));
+    max_x = std::max(max_x, std::max(s.x1, s.x2));
+    max_y = std::max(max_y, std::max(s.y1, s.y2));
+  }
+  if (segments_.empty()) {
+    min_x_ = min_y_ = max_x = max_y = 0;
+  }
+  min_x_ -= cell_;
+  min_y_ -= cell_;
+  nx_ = static_cast<int32_t>((max_x - min_x_) / cell_) + 2;
+  ny_ = static_cast<int32_t>((max_y - min_y_) / cell_) + 2;
+  cells_.assign(nx_ * ny_, std::vector<uint32_t>());
+  for (size_t i = 0; i < segments_.size(); i++) {
+    // 沿线段采样，落到哪个格子就登记到哪个格子
+    const SimSegment &s = segments_[i];
+    double len = std::hypot(s.x2 - s.x1, s.y2 - s.y1);
+    uint32_t samples = static_cast<uint32_t>(len / (cell_ / 4)) + 1;
+    for (uint32_t k = 0; k <= samples; k++) {
+      double f = static_cast<double>(k) / samples;
+      int32_t cx, cy;
+      cell_of(s.x1 + f * (s.x2 - s.x1), s.y1 + f * (s.y2 - s.y1), &cx, &cy);
+      std::vector<uint32_t> &bucket = cells_[cy * nx_ + cx];
+      if (bucket.empty() || bucket.back() != i) {
+        bucket.push_back(i);
+      }
+    }
+  }
+}
+
+bool SimWorld::cell_of(double x, double y, int32_t *cx, int32_t *cy) const {
+  *cx = static_cast<int32_t>(std::floor((x - min_x_) / cell_));
+  *cy = static_cast<int32_t>(std::floor((y - min_y_) / cell_));
+  return *cx >= 0 && *cy >= 0 && *cx < nx_ && *cy < ny_;
+}
+
+double SimWorld::hit(const SimSegment &s, double x, double y, double dx,
+                     double dy) const {
+  double ex = s.x2 - s.x1;
+  double ey = s.y2 - s.y1;
+  double denom = dx * ey - dy * ex;
+  if (std::fabs(denom) < 1e-12) {
+    return std::numeric_limits<double>::infinity();
+  }
+  double ax = s.x1 - x;
+  double ay = s.y1 - y;
+  double t = (ax * ey - ay * ex) / denom;
+  double u = (ax * dy - ay * dx) / denom;
+  if (t < 0 || u < 0 || u > 1) {
+    return std::numeric_limits<double>::infinity();
+  }
+  return t;
+}
+
+double SimWorld::raycast(double x, double y, double angle,
+                         double max_range) const {
+  double dx = std::cos(angle);
+  double dy = std::sin(angle);
+  double best = max_range;
+  int32_t cx, cy;
+  if (!cell_of(x, y, &cx, &cy)) {
+    for (size_t i = 0; i < segments_.size(); i++) {
+      best = std::min(best, hit(segments_[i], x, y, dx, dy));
+    }
+    return best;
+  }
+  // walk the grid cells along the ray, nearest first
+  const double inf = std::numeric_limits<double>::infinity();
+  int32_t step_x = dx > 0 ? 1 : -1;
+  int32_t step_y = dy > 0 ? 1 : -1;
+  double next_x = dx == 0 ? inf
+                          : ((cx + (dx > 0)) * cell_ + min_x_ - x) / dx;
+  double next_y = dy == 0 ? inf
+                          : ((cy + (dy > 0)) * cell_ + min_y_ - y) / dy;
+  double delta_x = dx == 0 ? inf : cell_ / std::fabs(dx);
+  double delta_y = dy == 0 ? inf : cell_ / std::fabs(dy);
+  while (true) {
+    const std::vector<uint32_t> &bucket = cells_[cy * nx_ + cx];
+    for (size_t i = 0; i < bucket.size(); i++) {
+      best = std::min(best, hit(segments_[bucket[i]], x, y, dx, dy));
+    }
+    double leave = std::min(next_x, next_y);
+    if (best <= leave) {
+      return best;
+    }
+    if (next_x < next_y) {
+      cx += step_x;
+      next_x += delta_x;
+    } else {
+      cy += step_y;
+      next_y += delta_y;
+    }
+    if (cx < 0 || cy < 0 || cx >= nx_ || cy >= ny_) {
+      return best;
+    }
+  }
+}
+
+bool SimWorld::collides(double x, double y, double radius) const {
+  int32_t x0, y0, x1, y1;
+  cell_of(x - radius, y - radius, &x0, &y0);
+  cell_of(x + radius, y + radius, &x1, &y1);
+  x0 = std::max(x0, 0);
+  y0 = std::max(y0, 0);
+  x1 = std::min(x1, nx_ - 1);
+  y1 = std::min(y1, ny_ - 1);
+  for (int32_t cy = y0; cy <= y1; cy++) {
+    for (int32_t cx = x0; cx <= x1; cx++) {
+      const std::vector<uint32_t> &bucket = cells_[cy * nx_ + cx];
+      for (size_t i = 0; i < bucket.size(); i++) {
+        const SimSegment &s = segments_[bucket[i]];
+        double ex = s.x2 - s.x1;
+        double ey = s.y2 - s.y1;
+        double len2 = ex * ex + ey * ey;
+        double f = len2 > 0 ? ((x - s.x1) * ex + (y - s.y1) * ey) / len2 : 0;
+        f = std::min(1.0, std::max(0.0, f));
+        if (std::hypot(s.x1 + f * ex - x, s.y1 + f * ey - y) < radius) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+Simulation::Simulation(const SimWorld &world)
+    : world_(world), now_(1000000000), next_step_(now_) {
+  pose_.x = 0;
+  pose_.y = 0;
+  pose_.theta = 0;
+  for (int i = 0; i < SIM_MAX_GPIO; i++) {
+    owner_[i] = -1;
+    level_[i] = 0;
+    group_size_[i] = 0;
+    duty_[i] = -1;
+  }
+}
+
+Simulation::~Simulation() { unbind(); }
+
+void Simulation::bind() { tls_sim = this; }
+
+void Simulation::unbind() {
+  if (tls_sim == this) {
+    tls_sim = nullptr;
+  }
+}
+
+Simulation *Simulation::current() { return tls_sim; }
+
+void Simulation::place(double x, double y, double theta) {
+  pose_.x = x;
+  pose_.y = y;
+  pose_.theta = theta;
+}
+
+void Simulation::advance(uint64_t ns) {
+  uint64_t target = now_ + ns;
+  while (next_step_ <= target) {
+    now_ = next_step_;
+    step(step_ns_ / 1e9);
+    next_step_ += step_ns_;
+  }
+  now_ = target;
+}
+
+double Simulation::duty_of(int gpio) const {
+  return duty_[gpio] >= 0 ? duty_[gpio] : level_[gpio] * 100.0;
+}
+
+void Simulation::step(double dt) {
+  double pan_step = car_.servo_rate * M_PI / 180 * dt;
+  pan_ += std::max(-pan_step, std::min(pan_step, pan_target_ - pan_));
+  for (int i = 0; i < 4; i++) {
+    double d1 = duty_of(wiring_.motor[i][0]);
+    double d2 = duty_of(wiring_.motor[i][1]);
+    double drive = d1 - d2;
+    double target = 0;
+    double tau = car_.tau_drive;
+    if (std::fabs(drive) > car_.dead_band) {
+      target = (std::fabs(drive) - car_.dead_band) /
+               (100 - car_.dead_band) * car_.max_wheel_speed;
+      target = drive > 0 ? target : -target;
+    } else if (d1 > 0 && d2 > 0) {
+      // AT8236: IN1=1 IN2=1 刹车
+      tau = car_.tau_brake;
+    } else if (drive == 0) {
+      tau = car_.tau_coast;
+    }
+    wheel_[i] += (target - wheel_[i]) * std::min(1.0, dt / tau);
+  }
+
+  double left = (wheel_[0] + wheel_[2]) / 2;
+  double right = (wheel_[1] + wheel_[3]) / 2;
+  double linear = (left + right) / 2;
+  double angular = (right - left) / car_.track * car_.skid_efficiency;
+  linear_ += (linear - linear_) * std::min(1.0, dt / car_.tau_linear);
+  angular_ += (angular - angular_) * std::min(1.0, dt / car_.tau_angular);
+
+  pose_.theta = std::remainder(pose_.theta + angular_ * dt, 2 * M_PI);
+  double x = pose_.x + linear_ * std::cos(pose_.theta) * dt;
+  double y = pose_.y + linear_ * std::sin(pose_.theta) * dt;
+  if (world_.collides(x, y, car_.radius)) {
+    // 撞墙了：停在原地，连续贴着墙只算一次
+    if (!contact_) {
+      collisions_++;
+    }
+    contact_ = true;
+    linear_ = 0;
+    return;
+  }
+  // a little margin so scraping along a wall is not counted over and over
+  contact_ = contact_ && world_.collides(x, y, car_.radius + 0.02);
+  odometer_ += std::hypot(x - pose_.x, y - pose_.y);
+  pose_.x = x;
+  pose_.y = y;
+}
+
+int Simulation::claim(int handle, int gpio, bool output) {
+  if (gpio < 0 || gpio >= SIM_MAX_GPIO) {
+    return LG_BAD_GPIO_NUMBER;
+  }
+  if (owner_[gpio] >= 0 && owner_[gpio] != handle) {
+    return LG_GPIO_BUSY;
+  }
+  owner_[gpio] = handle;
+  return 0;
+}
+
+int Simulation::release(int handle, int gpio) {
+  if (gpio < 0 || gpio >= SIM_MAX_GPIO || owner_[gpio] != handle) {
+    return LG_GPIO_NOT_ALLOCATED;
+  }
+  owner_[gpio] = -1;
+  duty_[gpio] = -1;
+  return 0;
+}
+
+int Simulation::write(int gpio, int level) {
+  if (gpio < 0 || gpio >= SIM_MAX_GPIO) {
+    return LG_BAD_GPIO_NUMBER;
+  }
+  int prev = level_[gpio];
+  level_[gpio] = level ? 1 : 0;
+  if (gpio == wiring_.sonar_trigger && prev && !level_[gpio]) {
+    ping();
+  }
+  return 0;
+}
+
+int Simulation::read(int gpio) {
+  if (gpio < 0 || gpio >= SIM_MAX_GPIO) {
+    return LG_BAD_GPIO_NUMBER;
+  }
+  if (gpio != wiring_.sonar_echo) {
+    return level_[gpio];
+  }
+  if (now_ < echo_start_) {
+    // nothing to see until the echo starts, skip the spin
+    advance(echo_start_ - now_);
+    return 0;
+  }
+  if (now_ < echo_end_) {
+    // resolution of the measured echo, 10us is 1.7mm
+    advance(10000);
+    return 1;
+  }
+  advance(1000);
+  return 0;
+}
+
+int Simulation::claim_group(int handle, int count, const int *gpios,
+                            bool output) {
+  if (count <= 0 || count > SIM_MAX_GPIO) {
+    return LG_BAD_GROUP_SIZE;
+  }
+  for (int i = 0; i < count; i++) {
+    if (gpios[i] < 0 || gpios[i] >= SIM_MAX_GPIO) {
+      return LG_BAD_GPIO_NUMBER;
+    }
+    if (owner_[gpios[i]] >= 0 && owner_[gpios[i]] != handle) {
+      return LG_GPIO_BUSY;
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    owner_[gpios[i]] = handle;
+    group_[gpios[0]][i] = static_cast<uint8_t>(gpios[i]);
+  }
+  group_size_[gpios[0]] = static_cast<uint8_t>(count);
+  return 0;
+}
+
+int Simulation::release_group(int handle, int leader) {
+  if (leader < 0 || leader >= SIM_MAX_GPIO || group_size_[leader] == 0) {
+    return LG_NOT_GROUP_LEADER;
+  }
+  for (int i = 0; i < group_size_[leader]; i++) {
+    release(handle, group_[leader][i]);
+  }
+  group_size_[leader] = 0;
+  return 0;
+}
+
+int Simulation::group_write(int leader, uint64_t bits, uint64_t mask) {
+  if (leader < 0 || leader >= SIM_MAX_GPIO || group_size_[leader] == 0) {
+    return LG_NOT_GROUP_LEADER;
+  }
+  for (int i = 0; i < group_size_[leader]; i++) {
+    if (mask >> i & 1) {
+      write(group_[leader][i], bits >> i & 1);
+    }
+  }
+  return 0;
+}
+
+int Simulation::group_read(int leader, uint64_t *bits) {
+  if (leader < 0 || leader >= SIM_MAX_GPIO || group_size_[leader] == 0) {
+    return LG_NOT_GROUP_LEADER;
+  }
+  *bits = 0;
+  for (int i = 0; i < group_size_[leader]; i++) {
+    *bits |= static_cast<uint64_t>(read(group_[leader][i]) & 1) << i;
+  }
+  return group_size_[leader];
+}
+
+int Simulation::pwm(int gpio, float freq, float duty) {
+  if (gpio < 0 || gpio >= SIM_MAX_GPIO) {
+    return LG_BAD_GPIO_NUMBER;
+  }
+  duty_[gpio] = (freq <= 0 || duty <= 0) ? -1 : duty;
+  return 0;
+}
+
+int Simulation::servo(int gpio, int pulse_width) {
+  if (gpio < 0 || gpio >= SIM_MAX_GPIO) {
+    return LG_BAD_GPIO_NUMBER;
+  }
+  if (gpio == wiring_.servo && pulse_width > 0) {
+    // 500us..2500us is 90 degrees right..90 degrees left
+    pan_target_ = -(pulse_width - 1500) / 1000.0 * M_PI / 2;
+  }
+  return 0;
+}
+
+double Simulation::sonar_reading(double pan) const {
+  // the servo turns the sonar where it sits
+  double x = pose_.x + car_.sonar_offset * std::cos(pose_.theta);
+  double y = pose_.y + car_.sonar_offset * std::sin(pose_.theta);
+  double range = car_.sonar_range;
+  for (int i = -2; i <= 2; i++) {
+    double a = pose_.theta + pan + i * car_.sonar_beam / 4 * M_PI / 180;
+    range = std::min(range, world_.raycast(x, y, a, car_.sonar_range));
+  }
+  return range;
+}
+
+void Simulation::ping() {
+  pings_++;
+  double range = sonar_reading(pan_);
+  // HC-SR04 raises the echo about 450us after the trigger and holds it
+  // 38ms when nothing comes back
+  echo_start_ = now_ + 450000;
+  uint64_t width = range < car_.sonar_range
+                       ? static_cast<uint64_t>(2 * range / SPEED_OF_SOUND * 1e9)
+                       : 38000000;
+  echo_end_ = echo_start_ + width;
+}
+
+void sim_build_course(uint32_t seed, SimCourse *course) {
+  double room[8] = {0, 0, 8, 0, 8, 6, 0, 6};
+  course->world.add_polygon(room, 4);
+  course->start.x = 1;
+  course->start.y = 1;
+  course->start.theta = 0;
+  course->goal_x = 7;
+  course->goal_y = 5;
+  course->goal_radius = 0.5;
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> px(0.5, 7.0);
+  std::uniform_real_distribution<double> py(0.5, 5.0);
+  std::uniform_real_distribution<double> size(0.2, 0.8);
+  for (int i = 0; i < 8; i++) {
+    double x = px(rng), y = py(rng), w = size(rng), h = size(rng);
+    // 起点和终点附近不放障碍
+    bool near_start = x < 1.5 && x + w > 0.5 && y < 1.5 && y + h > 0.5;
+    bool near_goal = x < 7.5 && x + w > 6.5 && y < 5.5 && y + h > 4.5;
+    if (near_start || near_goal) {
+      continue;
+    }
+    course->world.add_box(x, y, w, h);
+  }
+  course->world.build_index();
+}
+
+void sim_build_wall_course(SimCourse *course) {
+  double room[8] = {0, 0, 6, 0, 6, 4, 0, 4};
+  course->world.add_polygon(room, 4);
+  course->world.add_box(2.8, 0.9, 0.4, 2.2);
+  course->start.x = 1;
+  course->start.y = 2;
+  course->start.theta = 0;
+  course->goal_x = 5;
+  course->goal_y = 2;
+  course->goal_radius = 0.3;
+  course->world.build_index();
+}
+
+SimResult sim_planned(const SimCourse &course, double seconds) {
+  Simulation sim(course.world);
+  sim.place(course.start.x, course.start.y, course.start.theta);
+  sim.bind();
+  SimResult result = {0, 0, 0, -1, {}};
+  {
+    Car car;
+    if (car.init()) {
+      return result;
+    }
+    car.set_engine(30, 30, 50);
+    Sonar sonar(14, 15);
+    // the map starts at the start pose, as the autopilot's does. The pose
+    // is the simulation's own, the planner is under test here, not the
+    // odometry.
+    const Pose &start = course.start;
+    auto to_map = [&start](double x, double y, Pose *p) {
+      double c = std::cos(start.theta), s = std::sin(start.theta);
+      p->x = c * (x - start.x) + s * (y - start.y);
+      p->y = -s * (x - start.x) + c * (y - start.y);
+    };
+    OccupancyGrid grid;
+    if (grid.open("", 10, 10, 0.05)) {
+      return result;
+    }
+    GridPlanner planner(grid, 0.2);
+    WaypointFollower follower;
+    Pose goal, pose;
+    to_map(course.goal_x, course.goal_y, &goal);
+    if (planner.init() || planner.set_start(0, 0) ||
+        planner.set_goal(goal.x, goal.y)) {
+      return result;
+    }
+    SimCarParams params;
+    Waypoint path[64];
+    uint64_t begin = sim.now();
+    uint64_t end = begin + static_cast<uint64_t>(seconds * 1e9);
+    AllocStats warm;
+    alloc_stats(&warm);
+    for (uint64_t tick = 1; sim.now() < end; tick++) {
+      if (tick == SIM_WARMUP_TICKS) {
+        alloc_stats(&warm);
+      }
+      lguSleep(0.05);
+      to_map(sim.pose().x, sim.pose().y, &pose);
+      pose.theta = std::remainder(sim.pose().theta - start.theta, 2 * M_PI);
+      double range = sonar.get_distance();
+      // pong gives up after 20ms, about 3.4m: that far is no echo
+      grid.integrate(pose, 0,
+                     range < 3.3 ? range + params.sonar_offset
+                                 : params.sonar_range);
+      std::string cmd = "brake";
+      if (!planner.set_start(pose.x, pose.y)) {
+        planner.update_from_grid(grid);
+        if (planner.replan()) {
+          follower.set_path(path, planner.waypoints(path, 64));
+          cmd = follower.next_cmd(pose);
+        }
+      }
+      car.execute(cmd);
+      if (std::hypot(sim.pose().x - course.goal_x,
+                     sim.pose().y - course.goal_y) < course.goal_radius) {
+        result.completion = (sim.now() - begin) / 1e9;
+        break;
+      }
+    }
+    AllocStats done;
+    alloc_stats(&done);
+    alloc_diff(warm, done, &result.steady_allocs);
+    car.brake();
+    result.seconds = (sim.now() - begin) / 1e9;
+  }
+  result.distance = sim.odometer();
+  result.collisions = sim.collisions();
+  sim.unbind();
+  return result;
+}
+
+SimResult sim_autopilot(const SimCourse &course, const AutopilotParams &params,
+                        double seconds) {
+  Simulation sim(course.world);
+  sim.place(course.start.x, course.start.y, course.start.theta);
+  sim.bind();
+  SimResult result = {0, 0, 0, -1, {}};
+  // the same arena layout main() uses, one per run
+  std::unique_ptr<char[]> block(new char[CONTROL_ARENA_BYTES]);
+  ArenaResource arena(block.get(), CONTROL_ARENA_BYTES);
+  {
+    Car &car = *arena_new<Car>(&arena);
+    if (car.init()) {
+      return result;
+    }
+    std::unique_ptr<Commander, void (*)(Commander *)> commander(
+        make_sonar_commander(14, 15, params, &arena), destroy_commander);
+    uint64_t begin = sim.now();
+    uint64_t end = begin + static_cast<uint64_t>(seconds * 1e9);
+    AllocStats warm;
+    alloc_stats(&warm);
+    for (uint64_t tick = 1; sim.now() < end; tick++) {
+      if (tick == SIM_WARMUP_TICKS) {
+        alloc_stats(&warm);
+      }
+      lguSleep(0.1);
+      std::string cmd = commander->scan_cmd();
+      {
+        PhaseScope decide(PHASE_DECIDE);
+        uint32_t f_speed = 20, b_speed = 20, t_speed = 70;
+        commander->engine_hint(&f_speed, &b_speed, &t_speed);
+        car.set_engine(f_speed, b_speed, t_speed);
+      }
+      car.execute(cmd);
+      if (course.goal_radius > 0 &&
+          std::hypot(sim.pose().x - course.goal_x,
+                     sim.pose().y - course.goal_y) < course.goal_radius) {
+        result.completion = (sim.now() - begin) / 1e9;
+        break;
+      }
+    }
+    AllocStats done;
+    alloc_stats(&done);
+    alloc_diff(warm, done, &result.steady_allocs);
+    car.brake();
+    result.seconds = (sim.now() - begin) / 1e9;
+  }
+  result.distance = sim.odometer();
+  result.collisions = sim.collisions();
+  sim.unbind();
+  return result;
+}
+
+static void sim_deadline(void *car) { static_cast<Car *>(car)->stop(); }
+
+// stands in for the terminal, whose read would block
+class BrakeCommander : public Commander {
+public:
+  std::string scan_cmd() override { return "brake"; }
+};
+
+SimResult sim_dispatch(double seconds) {
+  SimWorld empty;
+  empty.build_index();
+  Simulation sim(empty);
+  sim.bind();
+  SimResult result = {0, 0, 0, -1, {}};
+  char js_path[64], socket_path[sizeof(sockaddr_un::sun_path)];
+  snprintf(js_path, sizeof(js_path), "/tmp/toy_car_sim_js.%d", getpid());
+  snprintf(socket_path, sizeof(socket_path), "/tmp/toy_car_sim.%d.sock",
+           getpid());
+  unlink(js_path);
+  // read and write, so the pad end opens without a reader
+  int pad = mkfifo(js_path, 0600) ? -1
+                                  : open(js_path, O_RDWR | O_NONBLOCK);
+  // a planner that went away must not kill the run
+  signal(SIGPIPE, SIG_IGN);
+  std::unique_ptr<char[]> block(new char[CONTROL_ARENA_BYTES]);
+  ArenaResource arena(block.get(), CONTROL_ARENA_BYTES);
+  {
+    Car &car = *arena_new<Car>(&arena);
+    AutopilotParams params;
+    params.map_path = "";
+    typedef std::unique_ptr<Commander, void (*)(Commander *)> Owned;
+    Owned js(make_joystick_commander(js_path, "js", true, 500000000ULL,
+                                     &arena),
+             destroy_commander);
+    Owned sonar(make_sonar_commander(14, 15, params, &arena),
+                destroy_commander);
+    Owned ring(make_commander("ring", &arena), destroy_commander);
+    Owned socket(make_socket_commander(socket_path, &arena),
+                 destroy_commander);
+    BrakeCommander terminal;
+    CmdRing *host = cmd_ring_producer_open();
+    if (pad < 0 || !host || car.init()) {
+      if (host) {
+        cmd_ring_close(host);
+      }
+      if (pad >= 0) {
+        close(pad);
+      }
+      unlink(js_path);
+      return result;
+    }
+    CommandSources sources = {js.get(), sonar.get(), &terminal, ring.get(),
+                              socket.get()};
+    // main()'s tick as it is, watchdog, state page and telemetry included,
+    // on a 1ms period of real time: the socket wait is real, the car's
+    // time moves with lguSleep() below. The page is a private one, the
+    // frames go to the discard port.
+    Watchdog watchdog(sim_deadline, &car);
+    watchdog.start();
+    CarStatePage page{};
+    TelemetrySender telemetry;
+    telemetry.open("127.0.0.1:9", 1000);
+    ControlLoop loop(sources, &car, &watchdog, 1000000);
+    loop.publish_to(&page, &telemetry);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+    int planner = -1;
+    uint32_t seq = 0;
+    uint64_t begin = sim.now();
+    uint64_t end = begin + static_cast<uint64_t>(seconds * 1e9);
+    // every thread counts, the watchdog's and the pad reader's too
+    AllocStats warm;
+    alloc_stats_all(&warm);
+    for (uint64_t tick = 1; sim.now() < end; tick++) {
+      if (tick == SIM_WARMUP_TICKS) {
+        alloc_stats_all(&warm);
+      }
+      lguSleep(0.05);
+      // the stick moves every tick, the host drives a third of the time
+      // and a planner another third
+      uint32_t turn = tick % 60 / 20;
+      JoystickEvent event;
+      memset(&event, 0, sizeof(event));
+      event.time = static_cast<uint32_t>(sim.now() / 1000000);
+      event.type = JS_EVENT_AXIS;
+      event.number = tick & 1 ? 4 : 5;
+      event.value = static_cast<short>(tick * 7919 % 65535 - 32767);
+      if (write(pad, &event, sizeof(event)) != sizeof(event)) {
+        break;
+      }
+      uint64_t now = monotonic_ns();
+      if (turn == 1) {
+        RingCommand cmd;
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.seq = ++seq;
+        snprintf(cmd.cmd, sizeof(cmd.cmd), "%s", tick & 1 ? "forward" : "drive");
+        cmd.sent_ns = now;
+        // the last one runs out at once and hands back to the pad
+        cmd.deadline = tick % 20 == 19 ? 1 : now + 1000000000ULL;
+        cmd.has_engine = true;
+        cmd.engine[0] = cmd.engine[1] = cmd.engine[2] = 50;
+        cmd.has_drive = !(tick & 1);
+        cmd.drive[0] = 40;
+        cmd.drive[1] = -40;
+        cmd_ring_push(host, cmd);
+      } else if (turn == 2) {
+        if (planner < 0) {
+          planner = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+          if (planner >= 0 &&
+              connect(planner, reinterpret_cast<struct sockaddr *>(&addr),
+                      sizeof(addr))) {
+            close(planner);
+            planner = -1;
+          }
+        }
+        ControlCommand cmd;
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.version = CONTROL_VERSION;
+        cmd.op = tick % (CONTROL_DRIVE + 1);
+        cmd.a = 500;
+        cmd.b = -300;
+        cmd.seq = ++seq;
+        if (planner >= 0) {
+          send(planner, &cmd, sizeof(cmd), MSG_DONTWAIT);
+          ControlAck ack;
+          while (recv(planner, &ack, sizeof(ack), MSG_DONTWAIT) > 0) {
+          }
+        }
+      } else if (planner >= 0) {
+        // the planner hangs up and the pad drives again
+        close(planner);
+        planner = -1;
+      }
+
+      loop.tick();
+    }
+    AllocStats done;
+    alloc_stats_all(&done);
+    alloc_diff(warm, done, &result.steady_allocs);
+    watchdog.stop();
+    car.brake();
+    result.seconds = (sim.now() - begin) / 1e9;
+    if (planner >= 0) {
+      close(planner);
+    }
+    cmd_ring_close(host);
+  }
+  close(pad);
+  unlink(js_path);
+  result.distance = sim.odometer();
+  result.collisions = sim.collisions();
+  sim.unbind();
+  return result;
+}
+
+bool sim_scan(const SimCourse &course, SimScan *out) {
+  Simulation sim(course.world);
+  sim.place(course.start.x, course.start.y, course.start.theta);
+  sim.bind();
+  bool ok;
+  {
+    Sonar sonar(14, 15);
+    PanScanner scanner(&sonar, SimWiring().servo);
+    ok = scanner.sweep(&out->profile);
+    uint32_t pings = sim.pings();
+    uint64_t start = sim.now();
+    ok = ok && scanner.sweep(&out->profile);
+    out->seconds = (sim.now() - start) / 1e9;
+    out->pings = sim.pings() - pings;
+    out->steps = scanner.steps();
+    out->min_cycle_ns = scanner.min_cycle_ns();
+    for (uint32_t i = 0; ok && i < out->profile.count; i++) {
+      out->truth_m[i] =
+          sim.sonar_reading(-out->profile.angle_deg[i] * M_PI / 180);
+    }
+  }
+  sim.unbind();
+  return ok;
+}
+
+double sim_turn_rate(uint32_t turn_speed) {
+  SimWorld empty;
+  empty.build_index();
+  Simulation sim(empty);
+  sim.bind();
+  Car car;
+  if (car.init()) {
+    return 0;
+  }
+  car.set_engine(turn_speed, turn_speed, turn_speed);
+  car.turn_right();
+  // let the wheels and the chassis spin up first
+  lguSleep(1.0);
+  double turned = 0;
+  double last = sim.pose().theta;
+  for (int i = 0; i < 100; i++) {
+    lguSleep(0.01);
+    turned += std::remainder(last - sim.pose().theta, 2 * M_PI);
+    last = sim.pose().theta;
+  }
+  car.brake();
+  sim.unbind();
+  return turned * 180 / M_PI;
+}
+
+double sim_heading_change(void (*start)(Car *car), double seconds) {
+  SimWorld empty;
+  empty.build_index();
+  Simulation sim(empty);
+  sim.bind();
+  Car car;
+  if (car.init()) {
+    return 0;
+  }
+  start(&car);
+  double turned = 0;
+  double last = sim.pose().theta;
+  for (double t = 0; t < seconds; t += 0.01) {
+    lguSleep(0.01);
+    turned += std::remainder(sim.pose().theta - last, 2 * M_PI);
+    last = sim.pose().theta;
+  }
+  car.brake();
+  sim.unbind();
+  return turned;
+}
@@ -0,0 +1,219 @@
+#pragma once
+#include "alloc_audit.h"
+#include "commander.h"
+#include "pose.h"
+#include "scanner.h"
+#include <stdint.h>
+#include <vector>
+
+#define SIM_MAX_GPIO 64
+
+class Car;
+
+struct SimSegment {
+  double x1;
+  double y1;
+  double x2;
+  double y2;
+};
+
+// Walls of the simulated course, with a uniform grid over the segments so
+// sonar rays and collision checks only look at nearby walls.
+class SimWorld {
+public:
+  SimWorld() {}
+  ~SimWorld() {}
+  // xy holds points pairs, the last point connects back to the first
+  void add_polygon(const double *xy, uint32_t points);
+  void add_box(double x, double y, double w, double h);
+  void build_index(double cell = 0.5);
+  // Distance to the first wall along the ray, max_range if there is none.
+  double raycast(double x, double y, double angle, double max_range) const;
+  bool collides(double x, double y, double radius) const;
+
+private:
+  bool cell_of(double x, double y, int32_t *cx, int32_t *cy) const;
+  double hit(const SimSegment &s, double x, double y, double dx,
+             double dy) const;
+
+private:
+  std::vector<SimSegment> segments_;
+  std::vector<std::vector<uint32_t> > cells_;
+  double min_x_{0};
+  double min_y_{0};
+  double cell_{0.5};
+  int32_t nx_{0};
+  int32_t ny_{0};
+};
+
+// The car's physical constants. Wheel speeds are ground speeds.
+struct SimCarParams {
+  // duty at which a wheel reaches max_wheel_speed
+  double max_wheel_speed{1.0};
+  // the motors stall below this duty, Motor::revise_speed keeps 20 as the
+  // lowest duty for that reason
+  double dead_band{15};
+  double track{0.15};
+  // skid steer loses part of the differential speed to wheel slip
+  double skid_efficiency{0.25};
+  double tau_drive{0.12};
+  double tau_coast{0.4};
+  double tau_brake{0.05};
+  // chassis inertia, linear and yaw
+  double tau_linear{0.08};
+  double tau_angular{0.06};
+  double radius{0.13};
+  // sonar sits this far ahead of the centre
+  double sonar_offset{0.12};
+  double sonar_range{4.0};
+  // HC-SR04 hears the nearest thing in a cone about 15 degrees wide
+  double sonar_beam{15};
+  // the pan servo turns the sonar about its mount, SG90 is about 0.1s per
+  // 60 degrees
+  double servo_rate{600};
+};
+
+// GPIO numbers as wired in gpio_table.txt.
+struct SimWiring {
+  // physical left rear, right rear, left front, right front. Car::turn_left
+  // drives the motors it names left forward, so on the chassis those sit
+  // on the right side.
+  int motor[4][2]{{23, 24}, {17, 27}, {20, 21}, {5, 6}};
+  int sonar_trigger{14};
+  int sonar_echo{15};
+  int servo{18};
+};
+
+// A 4WD skid-steer car in a SimWorld, driven through the same GPIO calls
+// Car and Sonar make. The lgpio stand-in in sim_lgpio.cpp forwards to the
+// simulation bound to the calling thread, and time only moves when the
+// code under test sleeps or polls, so runs are faster than real time and
+// each thread can run its own simulation.
+class Simulation {
+public:
+  Simulation(const SimWorld &world);
+  ~Simulation();
+  void bind();
+  void unbind();
+  static Simulation *current();
+
+  void place(double x, double y, double theta);
+  void advance(uint64_t ns);
+  uint64_t now() const { return now_; }
+  const Pose &pose() const { return pose_; }
+  uint32_t collisions() const { return collisions_; }
+  double odometer() const { return odometer_; }
+  // Pan of the sonar in radians, counter-clockwise positive, 0 straight
+  // ahead.
+  double pan() const { return pan_; }
+  uint32_t pings() const { return pings_; }
+  // What the sonar hears right now pointed pan radians off the heading,
+  // sonar_range if nothing.
+  double sonar_reading(double pan) const;
+
+  // GPIO side
+  int claim(int handle, int gpio, bool output);
+  int release(int handle, int gpio);
+  int write(int gpio, int level);
+  int read(int gpio);
+  int pwm(int gpio, float freq, float duty);
+  // pulse width in us, 0 lets the servo go limp where it is
+  int servo(int gpio, int pulse_width);
+  // groups are named by their first gpio, bit i is gpios[i]
+  int claim_group(int handle, int count, const int *gpios, bool output);
+  int release_group(int handle, int leader);
+  int group_write(int leader, uint64_t bits, uint64_t mask);
+  int group_read(int leader, uint64_t *bits);
+
+private:
+  void step(double dt);
+  double duty_of(int gpio) const;
+  void ping();
+
+private:
+  const SimWorld &world_;
+  SimCarParams car_;
+  SimWiring wiring_;
+  uint64_t now_;
+  uint64_t next_step_;
+  uint64_t step_ns_{1000000};
+
+  Pose pose_;
+  double wheel_[4]{0, 0, 0, 0};
+  double linear_{0};
+  double angular_{0};
+  bool contact_{false};
+  uint32_t collisions_{0};
+  double odometer_{0};
+
+  int owner_[SIM_MAX_GPIO];
+  int level_[SIM_MAX_GPIO];
+  uint8_t group_size_[SIM_MAX_GPIO];
+  uint8_t group_[SIM_MAX_GPIO][SIM_MAX_GPIO];
+  float duty_[SIM_MAX_GPIO];
+  uint64_t echo_start_{0};
+  uint64_t echo_end_{0};
+  uint32_t pings_{0};
+  double pan_{0};
+  double pan_target_{0};
+};
+
+struct SimCourse {
+  SimWorld world;
+  Pose start;
+  // the course is complete once the car gets within goal_radius of the
+  // goal, 0 radius means drive until the time is up
+  double goal_x;
+  double goal_y;
+  double goal_radius;
+};
+
+struct SimResult {
+  double seconds;
+  double distance;
+  uint32_t collisions;
+  // seconds to reach the goal, negative if it was not reached
+  double completion;
+  // heap use of the control loop after the first SIM_WARMUP_TICKS
+  AllocStats steady_allocs;
+};
+
+#define SIM_WARMUP_TICKS 100
+
+// Sweeps of the panning sonar, see sim_scan().
+struct SimScan {
+  ScanProfile profile;
+  // what the sonar hears at each angle of the profile, from the simulation
+  float truth_m[SCANNER_MAX_STEPS];
+  uint32_t steps;
+  uint32_t pings;
+  double seconds;
+  uint64_t min_cycle_ns;
+};
+
+// 8m x 6m room with random boxes, the goal in the far corner.
+void sim_build_course(uint32_t seed, SimCourse *course);
+// 6m x 4m room with a wall across the straight line from the start to the
+// goal, open at both ends.
+void sim_build_wall_course(SimCourse *course);
+// Drives the sonar autopilot the way main() does in auto mode.
+SimResult sim_autopilot(const SimCourse &course, const AutopilotParams &params,
+                        double seconds);
+// Drives to the course goal with GridPlanner and WaypointFollower: the
+// sonar goes into an in-memory grid and the path is repaired every tick as
+// walls show up.
+SimResult sim_planned(const SimCourse &course, double seconds);
+// Runs main()'s control loop tick (ControlLoop) for the given time with a
+// pad on a FIFO, the command ring and the control socket all fed, taking
+// turns at driving. The ring is the car's own, not to be run next to a
+// live car. steady_allocs counts every thread.
+SimResult sim_dispatch(double seconds);
+// Pans the sonar across twice with PanScanner, the car standing at the
+// course start, and keeps the second sweep, which starts where the first
+// one ended. Returns false if the scanner could not run.
+bool sim_scan(const SimCourse &course, SimScan *out);
+// Spin rate of the simulated car at a turn duty, in degrees per second.
+double sim_turn_rate(uint32_t turn_speed);
+// Heading change in radians, counter-clockwise positive, while start has
+// the car driving from rest for the given time.
+double sim_heading_change(void (*start)(Car *car), double seconds);
@@ -0,0 +1,127 @@
+// Stand-in for the parts of lgpio the car uses, backed by the Simulation
+// bound to the calling thread. Link it instead of -llgpio.
+#include "sim.h"
+extern "C" {
+#include "lgpio.h"
+}
+
+static int next_handle = 0;
+
+extern "C" {
+
+extern const char *const toy_gpio_backend_name = "sim";
+
+int lgGpiochipOpen(int gpioDev) {
+  if (!Simulation::current()) {
+    return LG_CANNOT_OPEN_CHIP;
+  }
+  return __sync_fetch_and_add(&next_handle, 1);
+}
+
+int lgGpiochipClose(int handle) { return 0; }
+
+int lgGpioClaimInput(int handle, int lFlags, int gpio) {
+  Simulation *sim = Simulation::current();
+  return sim ? sim->claim(handle, gpio, false) : LG_BAD_HANDLE;
+}
+
+int lgGpioClaimOutput(int handle, int lFlags, int gpio, int level) {
+  Simulation *sim = Simulation::current();
+  if (!sim) {
+    return LG_BAD_HANDLE;
+  }
+  int rc = sim->claim(handle, gpio, true);
+  return rc ? rc : sim->write(gpio, level);
+}
+
+int lgGpioFree(int handle, int gpio) {
+  Simulation *sim = Simulation::current();
+  return sim ? sim->release(handle, gpio) : LG_BAD_HANDLE;
+}
+
+int lgGpioRead(int handle, int gpio) {
+  Simulation *sim = Simulation::current();
+  return sim ? sim->read(gpio) : LG_BAD_HANDLE;
+}
+
+int lgGpioWrite(int handle, int gpio, int level) {
+  Simulation *sim = Simulation::current();
+  return sim ? sim->write(gpio, level) : LG_BAD_HANDLE;
+}
+
+int lgGroupClaimInput(int handle, int lFlags, int count, const int *gpios) {
+  Simulation *sim = Simulation::current();
+  return sim ? sim->claim_group(handle, count, gpios, false) : LG_BAD_HANDLE;
+}
+
+int lgGroupClaimOutput(int handle, int lFlags, int count, const int *gpios,
+                       const int *levels) {
+  Simulation *sim = Simulation::current();
+  if (!sim) {
+    return LG_BAD_HANDLE;
+  }
+  int rc = sim->claim_group(handle, count, gpios, true);
+  for (int i = 0; rc == 0 && i < count; i++) {
+    sim->write(gpios[i], levels[i]);
+  }
+  return rc;
+}
+
+int lgGroupFree(int handle, int gpio) {
+  Simulation *sim = Simulation::current();
+  return sim ? sim->release_group(handle, gpio) : LG_BAD_HANDLE;
+}
+
+int lgGroupRead(int handle, int gpio, uint64_t *groupBits) {
+  Simulation *sim = Simulation::current();
+  return sim ? sim->group_read(gpio, groupBits) : LG_BAD_HANDLE;
+}
+
+int lgGroupWrite(int handle, int gpio, uint64_t groupBits,
+                 uint64_t groupMask) {
+  Simulation *sim = Simulation::current();
+  return sim ? sim->group_write(gpio, groupBits, groupMask) : LG_BAD_HANDLE;
+}
+
+// no edge detection in the simulation
+int lgGpioClaimAlert(int handle, int lFlags, int eFlags, int gpio,
+                     int nfyHandle) {
+  return LG_NOT_PERMITTED;
+}
+
+int lgGpioSetAlertsFunc(int handle, int gpio, lgGpioAlertsFunc_t cbf,
+                        void *userdata) {
+  return LG_NOT_PERMITTED;
+}
+
+int lgTxPwm(int handle, int gpio, float pwmFrequency, float pwmDutyCycle,
+            int pwmOffset, int pwmCycles) {
+  Simulation *sim = Simulation::current();
+  return sim ? sim->pwm(gpio, pwmFrequency, pwmDutyCycle) : LG_BAD_HANDLE;
+}
+
+int lgTxServo(int handle, int gpio, int pulseWidth, int servoFrequency,
+              int servoOffset, int servoCycles) {
+  Simulation *sim = Simulation::current();
+  return sim ? sim->servo(gpio, pulseWidth) : LG_BAD_HANDLE;
+}
+
+uint64_t lguTimestamp(void) {
+  Simulation *sim = Simulation::current();
+  if (!sim) {
+    return 0;
+  }
+  // reading the clock costs a little, code spinning on it must move on
+  sim->advance(100);
+  return sim->now();
+}
+
+double lguTime(void) { return lguTimestamp() / 1e9; }
+
+void lguSleep(double sleepSecs) {
+  Simulation *sim = Simulation::current();
+  if (sim && sleepSecs > 0) {
+    sim->advance(static_cast<uint64_t>(sleepSecs * 1e9));
+  }
+}
+}
@@ -0,0 +1,292 @@
+#include "sim.h"
+#include "car.h"
+#include "mixer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Swallows everything written to it.
+class NullBuf : public std::streambuf {
+protected:
+  int overflow(int c) override { return traits_type::not_eof(c); }
+  std::streamsize xsputn(const char *, std::streamsize n) override {
+    return n;
+  }
+};
+
+struct TurnCase {
+  const char *name;
+  void (*start)(Car *car);
+};
+
+// Each pair has to turn the same way, the command words are the
+// reference.
+static int steering_check() {
+  static const TurnCase cases[][2] = {
+      {{"execute(\"right\")", [](Car *car) { car->execute("right"); }},
+       {"analog stick right", [](Car *car) {
+          int32_t left, right;
+          // stick right is y < 0 on the pad, JsCommander negates it
+          DriveMixer().mix(0, 32767, &left, &right);
+          car->set_drive(left, right);
+          car->execute("drive");
+        }}},
+      {{"turn_left()", [](Car *car) { car->turn_left(); }},
+       {"set_velocity(0, 0.8)", [](Car *car) { car->set_velocity(0, 0.8); }}},
+  };
+  int failed = 0;
+  for (const auto &pair : cases) {
+    double a = sim_heading_change(pair[0].start, 1.0);
+    double b = sim_heading_change(pair[1].start, 1.0);
+    bool same = (a > 0.1 && b > 0.1) || (a < -0.1 && b < -0.1);
+    printf("%s %+.2frad, %s %+.2frad%s\n", pair[0].name, a, pair[1].name, b,
+           same ? "" : "  FAIL: opposite turns");
+    failed += !same;
+  }
+  return failed ? 1 : 0;
+}
+
+// The planner has to find its way around a wall it only sees once it is
+// close, without touching it.
+static int planner_check(AutopilotParams params) {
+  SimCourse course;
+  sim_build_wall_course(&course);
+  SimResult r = sim_planned(course, 120);
+  printf("planner: %s after %.1fs, %.1fm driven, %u collisions\n",
+         r.completion < 0 ? "goal not reached" : "goal reached", r.seconds,
+         r.distance, r.collisions);
+  if (r.completion < 0 || r.collisions) {
+    printf("FAIL: the planner did not get around the wall\n");
+    return 1;
+  }
+  // the autopilot the same way, from its own dead reckoning
+  params.goal = true;
+  params.goal_x = course.goal_x - course.start.x;
+  params.goal_y = course.goal_y - course.start.y;
+  r = sim_autopilot(course, params, 120);
+  printf("autopilot: %s after %.1fs, %.1fm driven, %u collisions\n",
+         r.completion < 0 ? "goal not reached" : "goal reached", r.seconds,
+         r.distance, r.collisions);
+  if (r.completion < 0 || r.collisions) {
+    printf("FAIL: the autopilot did not get around the wall\n");
+    return 1;
+  }
+  return 0;
+}
+
+// One sweep of the panning sonar has to give a reading at every angle from
+// one ping each, the servo moves while the echo of the last ping dies down.
+static int scanner_check() {
+  SimCourse course;
+  double room[8] = {0, 0, 3, 0, 3, 2.5, 0, 2.5};
+  course.world.add_polygon(room, 4);
+  course.world.add_box(2.0, 0.4, 0.4, 0.5);
+  course.world.build_index();
+  course.start.x = 1;
+  course.start.y = 1.25;
+  course.start.theta = 0;
+  SimScan scan;
+  if (!sim_scan(course, &scan)) {
+    printf("FAIL: the scanner did not sweep\n");
+    return 1;
+  }
+  const ScanProfile &p = scan.profile;
+  double worst = 0, lo = 1e9, hi = 0;
+  for (uint32_t i = 0; i < p.count; i++) {
+    worst = std::max<double>(worst,
+                             std::fabs(p.range_m[i] - scan.truth_m[i]));
+    lo = std::min<double>(lo, p.range_m[i]);
+    hi = std::max<double>(hi, p.range_m[i]);
+  }
+  double per_angle = p.count ? scan.seconds / p.count : 0;
+  printf("scanner: %u angles from %.0f to %.0f deg in %.2fs, %u pings, "
+         "%.1fms per angle, %.2f..%.2fm, worst reading %.1fcm off\n",
+         p.count, p.count ? p.angle_deg[0] : 0.0,
+         p.count ? p.angle_deg[p.count - 1] : 0.0, scan.seconds, scan.pings,
+         per_angle * 1000, lo, hi, worst * 100);
+  int failed = 0;
+  if (p.count != scan.steps || p.angle_deg[0] != -90 ||
+      p.angle_deg[p.count - 1] != 90) {
+    printf("FAIL: the sweep does not cover -90..90 deg\n");
+    failed++;
+  }
+  if (worst > 0.02 || hi - lo < 0.5) {
+    printf("FAIL: the readings are not what the sonar sees at each angle\n");
+    failed++;
+  }
+  if (scan.pings != p.count ||
+      per_angle > scan.min_cycle_ns / 1e9 * 1.02) {
+    printf("FAIL: an angle costs more than one echo flight\n");
+    failed++;
+  }
+  return failed ? 1 : 0;
+}
+
+// The cruise control against the fixed min_speed duty it replaced, over
+// the same courses: it has to be several times faster without hitting
+// more per km.
+static int cruise_check(const AutopilotParams &base, double hours) {
+  const uint32_t seeds = 8;
+  double distance[2] = {0, 0}, seconds[2] = {0, 0};
+  uint32_t collisions[2] = {0, 0};
+  for (int cruise = 0; cruise < 2; cruise++) {
+    AutopilotParams params = base;
+    params.cruise = cruise;
+    for (uint32_t seed = 1; seed <= seeds; seed++) {
+      SimCourse course;
+      sim_build_course(seed, &course);
+      course.goal_radius = 0;
+      SimResult r = sim_autopilot(course, params, hours * 3600 / seeds);
+      distance[cruise] += r.distance;
+      seconds[cruise] += r.seconds;
+      collisions[cruise] += r.collisions;
+    }
+  }
+  double speed[2], per_km[2];
+  for (int cruise = 0; cruise < 2; cruise++) {
+    speed[cruise] = distance[cruise] / seconds[cruise];
+    per_km[cruise] =
+        distance[cruise] > 0 ? collisions[cruise] / distance[cruise] * 1000
+                             : 0;
+    printf("%-6s %3u courses: %.1fm, average speed %.3fm/s, %u collisions "
+           "(%.2f per km)\n",
+           cruise ? "cruise" : "fixed", seeds, distance[cruise],
+           speed[cruise], collisions[cruise], per_km[cruise]);
+  }
+  int failed = 0;
+  if (speed[1] < 3 * speed[0]) {
+    printf("FAIL: cruise control is not three times as fast as the fixed duty\n");
+    failed++;
+  }
+  if (per_km[1] > per_km[0]) {
+    printf("FAIL: cruise control hits more per km than the fixed duty\n");
+    failed++;
+  }
+  return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+  double hours = 1;
+  uint32_t seed = 1;
+  bool alloc_check = false;
+  bool steer_check = false;
+  bool plan_check = false;
+  bool speed_check = false;
+  bool scan_check = false;
+  AutopilotParams params;
+  params.map_path = "";
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--hours") && i + 1 < argc) {
+      hours = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--zigzag")) {
+      params.sweep = false;
+    } else if (!strcmp(argv[i], "--fixed-speed")) {
+      params.cruise = false;
+    } else if (!strcmp(argv[i], "--scan")) {
+      params.scan_servo = SimWiring().servo;
+    } else if (!strcmp(argv[i], "--cruise-check")) {
+      speed_check = true;
+    } else if (!strcmp(argv[i], "--scanner-check")) {
+      scan_check = true;
+    } else if (!strcmp(argv[i], "--alloc-check")) {
+      alloc_check = true;
+    } else if (!strcmp(argv[i], "--steering-check")) {
+      steer_check = true;
+    } else if (!strcmp(argv[i], "--planner-check")) {
+      plan_check = true;
+    } else {
+      printf("usage: %s [--hours H] [--seed N] [--zigzag] [--fixed-speed] "
+             "[--scan] [--alloc-check] [--steering-check] [--planner-check] "
+             "[--cruise-check] [--scanner-check]\n",
+             argv[0]);
+      return 1;
+    }
+  }
+
+  if (steer_check) {
+    std::cout.setstate(std::ios_base::badbit);
+    int rc = steering_check();
+    std::cout.clear();
+    return rc;
+  }
+
+  if (plan_check) {
+    std::cout.setstate(std::ios_base::badbit);
+    params.turn_rate_dps = sim_turn_rate(params.turn_speed);
+    int rc = planner_check(params);
+    std::cout.clear();
+    return rc;
+  }
+
+  if (scan_check) {
+    std::cout.setstate(std::ios_base::badbit);
+    int rc = scanner_check();
+    std::cout.clear();
+    return rc;
+  }
+
+  if (speed_check) {
+    std::cout.setstate(std::ios_base::badbit);
+    params.turn_rate_dps = sim_turn_rate(params.turn_speed);
+    int rc = cruise_check(params, hours);
+    std::cout.clear();
+    return rc;
+  }
+
+  SimCourse course;
+  sim_build_course(seed, &course);
+  // drive around for the whole time instead of stopping at the goal
+  course.goal_radius = 0;
+  // the control code logs every tick, far too much at simulation speed.
+  // The allocation check keeps the formatting and drops only the output.
+  NullBuf null_buf;
+  std::streambuf *cout_buf = std::cout.rdbuf();
+  if (alloc_check) {
+    std::cout.rdbuf(&null_buf);
+  } else {
+    std::cout.setstate(std::ios_base::badbit);
+  }
+  // what toy_car_spin measures on a real floor
+  params.turn_rate_dps = sim_turn_rate(params.turn_speed);
+  auto t0 = std::chrono::steady_clock::now();
+  SimResult r = sim_autopilot(course, params, hours * 3600);
+  // and the pad, host and planner commands the autopilot never sees
+  SimResult d = {0, 0, 0, -1, {}};
+  if (alloc_check) {
+    d = sim_dispatch(60);
+  }
+  double wall =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - t0)
+          .count();
+  std::cout.rdbuf(cout_buf);
+  std::cout.clear();
+
+  printf("simulated %.0fs in %.2fs (%.0fx real time)\n", r.seconds, wall,
+         r.seconds / wall);
+  printf("distance %.1fm, average speed %.3fm/s\n", r.distance,
+         r.distance / r.seconds);
+  printf("collisions %u (%.2f per km)\n", r.collisions,
+         r.distance > 0 ? r.collisions / r.distance * 1000 : 0.0);
+  if (alloc_check) {
+    if (d.seconds == 0) {
+      printf("FAIL: could not set up the pad, ring and socket dispatch\n");
+      return 1;
+    }
+    bool sonar = alloc_report("steady state heap use:", r.steady_allocs);
+    bool dispatch =
+        alloc_report("pad, ring and socket dispatch:", d.steady_allocs);
+    if (sonar || dispatch) {
+      printf("FAIL: the control loop allocates after %d ticks\n",
+             SIM_WARMUP_TICKS);
+      return 1;
+    }
+    printf("no allocations after %d ticks\n", SIM_WARMUP_TICKS);
+  }
+  return 0;
+}
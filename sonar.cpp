@@ -1,5 +1,6 @@
 #include "sonar.h"
 #include "lgpio.h"
+#include "trace.h"
 #include <iostream>
 
 Sonar::Sonar(uint32_t t, uint32_t r) : trigger_(t), response_(r) {
@@ -13,13 +14,16 @@ Sonar::Sonar(uint32_t t, uint32_t r) : trigger_(t), response_(r) {
     uint64_t cost_time = pong();
 
     //std::cout<<"transfer cost time..............:"<<cost_time<<std::endl;
-    double distance = cost_time *
-                        (343.2 / 1000 / 1000) /*meters per micro second*/ /
-                        2 /*go and back,*/;
-    return distance;
+    return echo_to_distance(cost_time);
+  }
+
+  double Sonar::echo_to_distance(uint64_t echo_us) {
+    return echo_us * (343.2 / 1000 / 1000) /*meters per micro second*/ /
+           2 /*go and back,*/;
   }
 
   void Sonar::ping() {
+    TRACE_SPAN("Sonar::ping");
     uint64_t start = lguTimestamp();
     //trigger signal start
     lgGpioWrite(io_handle_,trigger_,1);
@@ -32,6 +36,7 @@ Sonar::Sonar(uint32_t t, uint32_t r) : trigger_(t), response_(r) {
   }
 
   uint64_t Sonar::pong() {
+    TRACE_SPAN("Sonar::pong");
     //std::cout<<"start to pong, value:"<<lgGpioRead(io_handle_,response_)<<std::endl;
     uint64_t start = lguTimestamp();
     uint64_t now;
@@ -42,7 +47,7 @@ Sonar::Sonar(uint32_t t, uint32_t r) : trigger_(t), response_(r) {
     } while (value == 0 && now -start < timeout_);
 
     if (value == 0) {
-      std::cout<<"should not happen, can't get the begin of echo"<<std::endl;
+      missed_++;
       return 0;
     }
 
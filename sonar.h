@@ -1,9 +1,16 @@
+#pragma once
+#include <atomic>
 #include <stdint.h>
 class Sonar {
 public:
   Sonar(uint32_t t, uint32_t r);
   ~Sonar() {}
   double get_distance();
+  // Echo pulse width in microseconds to meters.
+  static double echo_to_distance(uint64_t echo_us);
+  // Pings whose echo never started. Counted, not printed: the sonar is
+  // pinged from helper threads too.
+  uint32_t missed() const { return missed_.load(); }
 private:
   void ping();
   uint64_t pong();
@@ -12,4 +19,5 @@ private:
   uint32_t trigger_;
   uint32_t response_;
   uint64_t timeout_{20000000};
+  std::atomic<uint32_t> missed_{0};
 };
\ No newline at end of file
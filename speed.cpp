@@ -0,0 +1,43 @@
+#include "speed.h"
+#include <algorithm>
+#include <limits>
+
+void SpeedController::reset() {
+  last_distance_ = -1;
+  last_ns_ = 0;
+  closing_speed_ = 0;
+  ttc_ = 0;
+}
+
+uint32_t SpeedController::update(double distance, uint64_t now_ns) {
+  if (last_distance_ >= 0 && now_ns > last_ns_) {
+    double dt = (now_ns - last_ns_) / 1e9;
+    if (dt < 1.0) {
+      double raw = (last_distance_ - distance) / dt;
+      // 单次跳变多半是回波丢失，限幅后再滤波
+      raw = std::min(3.0, std::max(-3.0, raw));
+      closing_speed_ = alpha_ * raw + (1 - alpha_) * closing_speed_;
+    } else {
+      closing_speed_ = 0;
+    }
+  }
+  last_distance_ = distance;
+  last_ns_ = now_ns;
+
+  double margin = distance - stop_distance_;
+  if (margin <= 0) {
+    ttc_ = 0;
+    return 0;
+  }
+  ttc_ = closing_speed_ > 0.05 ? margin / closing_speed_
+                               : std::numeric_limits<double>::infinity();
+  if (ttc_ < ttc_brake_) {
+    return 0;
+  }
+
+  double frac = std::min(1.0, margin / (full_distance_ - stop_distance_));
+  if (ttc_ < ttc_slow_) {
+    frac *= (ttc_ - ttc_brake_) / (ttc_slow_ - ttc_brake_);
+  }
+  return static_cast<uint32_t>(min_duty_ + frac * (max_duty_ - min_duty_));
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <algorithm>
+#include <stdint.h>
+
+// Forward duty for sonar auto-drive. The duty grows with the measured
+// clearance and shrinks with the estimated closing speed; update() returns
+// 0 when the predicted time to collision is too short and the car should
+// brake.
+class SpeedController {
+public:
+  SpeedController() {}
+  // stop_distance is the autopilot's safe distance: the car has to stop
+  // where a heading still counts as free, or the escape finds none
+  SpeedController(double min_duty, double max_duty, double stop_distance,
+                  double ttc_brake)
+      : min_duty_(min_duty), max_duty_(max_duty),
+        stop_distance_(stop_distance),
+        full_distance_(std::max(2.0, stop_distance + 1.0)),
+        ttc_brake_(ttc_brake), ttc_slow_(ttc_brake + 0.9) {}
+  ~SpeedController() {}
+  uint32_t update(double distance, uint64_t now_ns);
+  void reset();
+  double closing_speed() const { return closing_speed_; }
+  double time_to_collision() const { return ttc_; }
+
+private:
+  double min_duty_{20};
+  double max_duty_{80};
+  // never closer than this, whatever the closing speed is
+  double stop_distance_{0.4};
+  // clearance at which max_duty_ is allowed
+  double full_distance_{2.0};
+  // brake below ttc_brake_, scale down between ttc_brake_ and ttc_slow_
+  double ttc_brake_{0.6};
+  double ttc_slow_{1.5};
+  // low pass filter on the closing speed, sonar readings are noisy
+  double alpha_{0.4};
+
+  double last_distance_{-1};
+  uint64_t last_ns_{0};
+  double closing_speed_{0};
+  double ttc_{0};
+};
@@ -0,0 +1,50 @@
+// Spins the car in place at the autopilot's turn duty for a fixed time, to
+// calibrate AutopilotParams::turn_rate_dps on the floor it drives on: mark
+// where the car points, let it spin, then count the turns and read the
+// rest of the last one off the mark. It starts from standstill, as the
+// escape sweep does.
+#include "car.h"
+#include "commander.h"
+extern "C" {
+#include "lgpio.h"
+}
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+int main(int argc, char **argv) {
+  uint32_t speed = AutopilotParams().turn_speed;
+  double seconds = 6;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--speed") && i + 1 < argc) {
+      speed = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else {
+      printf("usage: %s [--speed DUTY] [--seconds S]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (speed == 0 || speed > 100 || seconds <= 0) {
+    printf("need a duty of 1..100 and a positive time\n");
+    return 1;
+  }
+
+  // Car logs every motion call
+  std::cout.setstate(std::ios_base::badbit);
+  Car car;
+  int rc = car.init();
+  if (rc) {
+    printf("failed to init the car, rc:%d\n", rc);
+    return 1;
+  }
+  car.set_engine(speed, speed, speed);
+  car.turn_right();
+  lguSleep(seconds);
+  car.brake();
+  printf("spun right at duty %u for %.1fs\n", speed, seconds);
+  printf("TOY_CAR_TURN_RATE=<360 * turns / %.1f>, e.g. %.0f for 2 turns\n",
+         seconds, 720 / seconds);
+  return 0;
+}
@@ -0,0 +1,106 @@
+#include "telemetry.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static uint32_t to_us(uint64_t ns) {
+  return static_cast<uint32_t>(std::min<uint64_t>(ns / 1000, UINT32_MAX));
+}
+
+void telemetry_pack(const CarState &state, uint64_t seq, uint64_t dropped,
+                    TelemetryFrame *frame) {
+  memset(frame, 0, sizeof(*frame));
+  frame->magic = TELEMETRY_MAGIC;
+  frame->version = TELEMETRY_VERSION;
+  frame->size = sizeof(*frame);
+  frame->seq = seq;
+  frame->stamp = state.stamp;
+  frame->tick = state.tick;
+  memcpy(frame->cmd, state.cmd, sizeof(frame->cmd));
+  memcpy(frame->source, state.source, sizeof(frame->source));
+  frame->cmd[sizeof(frame->cmd) - 1] = 0;
+  frame->source[sizeof(frame->source) - 1] = 0;
+  for (int i = 0; i < CAR_STATE_MOTORS; i++) {
+    frame->duty[i] = state.duty[i];
+  }
+  for (int i = 0; i < CAR_STATE_IR; i++) {
+    frame->ir[i] = state.ir[i];
+  }
+  frame->blocked = state.blocked != 0;
+  frame->sonar_mm = state.sonar_m < 0 ? -1 : state.sonar_m * 1000;
+  frame->loop_us = to_us(state.loop_ns);
+  frame->loop_max_us = to_us(state.loop_max_ns);
+  frame->input_p99_us = to_us(state.input_p99_ns);
+  frame->stale = state.stale;
+  frame->dropped = dropped;
+}
+
+bool telemetry_check(const void *data, size_t bytes) {
+  if (bytes != sizeof(TelemetryFrame)) {
+    return false;
+  }
+  const TelemetryFrame *frame = static_cast<const TelemetryFrame *>(data);
+  return frame->magic == TELEMETRY_MAGIC &&
+         frame->version == TELEMETRY_VERSION && frame->size == bytes;
+}
+
+int TelemetrySender::open(const char *dest, double hz) {
+  close();
+  if (hz <= 0) {
+    return -1;
+  }
+  char host[64];
+  snprintf(host, sizeof(host), "%s", TELEMETRY_DEFAULT_ADDR);
+  int port = TELEMETRY_DEFAULT_PORT;
+  if (dest && dest[0]) {
+    const char *colon = strrchr(dest, ':');
+    if (colon) {
+      snprintf(host, sizeof(host), "%.*s", static_cast<int>(colon - dest),
+               dest);
+      port = atoi(colon + 1);
+    } else {
+      port = atoi(dest);
+    }
+  }
+  memset(&addr_, 0, sizeof(addr_));
+  addr_.sin_family = AF_INET;
+  addr_.sin_port = htons(port);
+  if (port <= 0 || port > 65535 || inet_pton(AF_INET, host, &addr_.sin_addr) != 1) {
+    return -1;
+  }
+  fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd_ < 0) {
+    return -1;
+  }
+  period_ns_ = static_cast<uint64_t>(1e9 / hz);
+  next_ns_ = 0;
+  return 0;
+}
+
+void TelemetrySender::close() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+void TelemetrySender::send(const CarState &state, uint64_t now) {
+  TelemetryFrame frame;
+  telemetry_pack(state, sent_ + dropped_ + 1, dropped_, &frame);
+  // not connected, so a missing receiver does not come back as an error
+  // on the next send
+  if (sendto(fd_, &frame, sizeof(frame), MSG_DONTWAIT,
+             reinterpret_cast<const struct sockaddr *>(&addr_),
+             sizeof(addr_)) == sizeof(frame)) {
+    sent_++;
+  } else {
+    dropped_++;
+  }
+  // a slow loop does not send a burst to catch up
+  next_ns_ = next_ns_ && next_ns_ + period_ns_ > now ? next_ns_ + period_ns_
+                                                     : now + period_ns_;
+}
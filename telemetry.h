@@ -0,0 +1,72 @@
+#pragma once
+#include "car_state.h"
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TELEMETRY_MAGIC 0x31544354 // "TCT1"
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_DEFAULT_ADDR "127.0.0.1"
+#define TELEMETRY_DEFAULT_PORT 47800
+#define TELEMETRY_DEFAULT_HZ 10
+
+// One UDP datagram, the layout is the schema: fixed width fields, no
+// padding, little endian as on every machine the car and its tools run on.
+// Readings the car does not have are -1.
+struct TelemetryFrame {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;
+  uint64_t seq;
+  uint64_t stamp; // lguTimestamp() of the snapshot
+  uint64_t tick;
+  char cmd[16];
+  char source[16];
+  // left rear, right rear, left front, right front
+  int16_t duty[CAR_STATE_MOTORS];
+  int8_t ir[CAR_STATE_IR];
+  uint8_t blocked;
+  uint8_t reserved[3];
+  int32_t sonar_mm;
+  uint32_t loop_us;
+  uint32_t loop_max_us;
+  uint32_t input_p99_us;
+  uint64_t stale;
+  // frames the sender had to drop before this one
+  uint64_t dropped;
+};
+static_assert(sizeof(TelemetryFrame) == 112, "telemetry schema changed");
+
+// Fills frame from a state snapshot.
+void telemetry_pack(const CarState &state, uint64_t seq, uint64_t dropped,
+                    TelemetryFrame *frame);
+// Returns false if the datagram is not a frame of this version.
+bool telemetry_check(const void *data, size_t bytes);
+
+// Sends frames at a fixed rate without ever blocking: whatever the socket
+// does not take at once is dropped and counted.
+class TelemetrySender {
+public:
+  TelemetrySender() {}
+  ~TelemetrySender() { close(); }
+  // dest is "ADDR:PORT", "PORT" or empty for the loopback default.
+  int open(const char *dest, double hz);
+  void close();
+  bool is_open() const { return fd_ >= 0; }
+  // A frame is wanted at now (monotonic_ns()). A quarter period early
+  // still counts, the loop wakes up with some jitter.
+  bool due(uint64_t now) const {
+    return fd_ >= 0 && now + period_ns_ / 4 >= next_ns_;
+  }
+  void send(const CarState &state, uint64_t now);
+  uint64_t sent() const { return sent_; }
+  uint64_t dropped() const { return dropped_; }
+
+private:
+  int fd_{-1};
+  struct sockaddr_in addr_ {};
+  uint64_t period_ns_{0};
+  uint64_t next_ns_{0};
+  uint64_t sent_{0};
+  uint64_t dropped_{0};
+};
@@ -0,0 +1,139 @@
+// Receives the telemetry frames a toy_car sends and writes them as CSV,
+// one row per frame. Lost frames are reported on stderr.
+#include "telemetry.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_stop(int sig) { stop_requested = 1; }
+
+// a comma or quote in a command word must not shift the columns
+static void print_field(const char *text) {
+  if (!strpbrk(text, ",\"")) {
+    printf("%s", text);
+    return;
+  }
+  putchar('"');
+  for (const char *p = text; *p; p++) {
+    if (*p == '"') {
+      putchar('"');
+    }
+    putchar(*p);
+  }
+  putchar('"');
+}
+
+static void print_row(const TelemetryFrame &f) {
+  printf("%lu,%lu,%lu,", static_cast<unsigned long>(f.seq),
+         static_cast<unsigned long>(f.stamp),
+         static_cast<unsigned long>(f.tick));
+  print_field(f.cmd);
+  putchar(',');
+  print_field(f.source);
+  for (int i = 0; i < CAR_STATE_MOTORS; i++) {
+    printf(",%d", f.duty[i]);
+  }
+  printf(",%d", f.blocked);
+  if (f.sonar_mm < 0) {
+    printf(",");
+  } else {
+    printf(",%.3f", f.sonar_mm / 1000.0);
+  }
+  for (int i = 0; i < CAR_STATE_IR; i++) {
+    if (f.ir[i] < 0) {
+      printf(",");
+    } else {
+      printf(",%d", f.ir[i]);
+    }
+  }
+  printf(",%u,%u,%u,%lu,%lu\n", f.loop_us, f.loop_max_us, f.input_p99_us,
+         static_cast<unsigned long>(f.stale),
+         static_cast<unsigned long>(f.dropped));
+}
+
+int main(int argc, char **argv) {
+  const char *bind_addr = TELEMETRY_DEFAULT_ADDR;
+  int port = TELEMETRY_DEFAULT_PORT;
+  long count = -1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--bind") && i + 1 < argc) {
+      bind_addr = argv[++i];
+    } else if (!strcmp(argv[i], "--port") && i + 1 < argc) {
+      port = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--count") && i + 1 < argc) {
+      count = atol(argv[++i]);
+    } else {
+      printf("usage: %s [--bind ADDR] [--port N] [--count FRAMES]\n",
+             argv[0]);
+      return 1;
+    }
+  }
+  // no SA_RESTART, the blocked recv has to give up
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_stop;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || inet_pton(AF_INET, bind_addr, &addr.sin_addr) != 1 ||
+      bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr))) {
+    fprintf(stderr, "failed to bind %s:%d: %s\n", bind_addr, port,
+            strerror(errno));
+    return 1;
+  }
+
+  printf("seq,stamp_ns,tick,cmd,source,duty_left_rear,duty_right_rear,"
+         "duty_left_front,duty_right_front,blocked,sonar_m,ir1,ir2,ir3,ir4,"
+         "loop_us,loop_max_us,input_p99_us,stale,sender_dropped\n");
+  fflush(stdout);
+  uint64_t last_seq = 0;
+  uint64_t lost = 0;
+  uint64_t bad = 0;
+  for (long rows = 0; !stop_requested && rows != count;) {
+    TelemetryFrame frame;
+    ssize_t bytes = recv(fd, &frame, sizeof(frame), MSG_TRUNC);
+    if (bytes < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "recv: %s\n", strerror(errno));
+      break;
+    }
+    if (!telemetry_check(&frame, bytes)) {
+      bad++;
+      continue;
+    }
+    frame.cmd[sizeof(frame.cmd) - 1] = 0;
+    frame.source[sizeof(frame.source) - 1] = 0;
+    if (last_seq && frame.seq > last_seq + 1) {
+      // the car's drops are in the frame, the rest went missing on the way
+      lost += frame.seq - last_seq - 1;
+      fprintf(stderr, "frames %lu..%lu missing\n",
+              static_cast<unsigned long>(last_seq + 1),
+              static_cast<unsigned long>(frame.seq - 1));
+    } else if (frame.seq <= last_seq) {
+      fprintf(stderr, "sequence restarted at %lu, car restarted?\n",
+              static_cast<unsigned long>(frame.seq));
+    }
+    last_seq = frame.seq;
+    print_row(frame);
+    fflush(stdout);
+    rows++;
+  }
+  close(fd);
+  fprintf(stderr, "%lu frames missing, %lu datagrams not understood\n",
+          static_cast<unsigned long>(lost), static_cast<unsigned long>(bad));
+  return 0;
+}
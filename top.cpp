@@ -0,0 +1,97 @@
+// Redraws the state a running toy_car publishes in shared memory. Reads
+// only, the car never waits on it.
+#include "car_state.h"
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <thread>
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_stop(int sig) { stop_requested = 1; }
+
+static uint64_t realtime_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void draw(const CarStatePage *page, const CarState &s) {
+  static const char *motors[CAR_STATE_MOTORS] = {"left rear", "right rear",
+                                                 "left front", "right front"};
+  // home and clear, then the whole page
+  printf("\033[H\033[2J");
+  uint64_t now = realtime_ns();
+  double age = now > s.stamp ? (now - s.stamp) / 1e9 : 0;
+  printf("toy_car pid %u  tick %lu  updated %.1fs ago\n\n", page->pid,
+         static_cast<unsigned long>(s.tick), age);
+  printf("command  %-12s from %s%s\n\n", s.cmd, s.source,
+         s.blocked ? "  [obstacle, forward blocked]" : "");
+  for (int i = 0; i < CAR_STATE_MOTORS; i++) {
+    printf("%-12s %+4d%%\n", motors[i], s.duty[i]);
+  }
+  printf("\n");
+  if (s.sonar_m >= 0) {
+    printf("sonar    %.2fm\n", s.sonar_m);
+  } else {
+    printf("sonar    -\n");
+  }
+  printf("infrared");
+  for (int i = 0; i < CAR_STATE_IR; i++) {
+    if (s.ir[i] < 0) {
+      printf(" -");
+    } else {
+      printf(" %s", s.ir[i] ? "clear" : "BLOCKED");
+    }
+  }
+  printf("\n\n");
+  printf("loop     %.2fms last  %.2fms max\n", s.loop_ns / 1e6,
+         s.loop_max_ns / 1e6);
+  printf("stale    %lu commands refused\n",
+         static_cast<unsigned long>(s.stale));
+  printf("stick    %.1fms p99 to the wheels\n", s.input_p99_ns / 1e6);
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  double interval = 0.2;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--interval") && i + 1 < argc) {
+      interval = atof(argv[++i]);
+    } else {
+      printf("usage: %s [--interval SECONDS]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (interval <= 0) {
+    printf("interval must be positive\n");
+    return 1;
+  }
+  signal(SIGINT, on_stop);
+  signal(SIGTERM, on_stop);
+
+  const CarStatePage *page = nullptr;
+  auto period = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::duration<double>(interval));
+  auto next = std::chrono::steady_clock::now();
+  while (!stop_requested) {
+    if (!page) {
+      page = car_state_view_open();
+    }
+    CarState state;
+    if (!page) {
+      printf("\033[H\033[2Jwaiting for toy_car to publish %s\n",
+             CAR_STATE_SHM);
+      fflush(stdout);
+    } else if (car_state_read(page, &state)) {
+      draw(page, state);
+    }
+    next += period;
+    std::this_thread::sleep_until(next);
+  }
+  printf("\n");
+  return 0;
+}
@@ -0,0 +1,152 @@
+#include "trace.h"
+#include "phase.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+struct TraceEvent {
+  const char *name;
+  uint64_t begin;
+  uint64_t end;
+  // phases go on their own track, they don't nest with the spans
+  bool phase;
+};
+
+// Written only by its thread. next is published with release, so the
+// exporter sees complete events up to it.
+struct TraceBuffer {
+  TraceEvent events[TRACE_EVENTS_PER_THREAD];
+  std::atomic<uint64_t> next{0};
+  long tid{0};
+  char name[16];
+  uint64_t phase_begin{0};
+  TraceBuffer *older{nullptr};
+};
+
+static std::atomic<bool> trace_on{false};
+static uint64_t trace_origin = 0;
+static std::atomic<TraceBuffer *> buffers{nullptr};
+static thread_local TraceBuffer *tls_buffer = nullptr;
+
+static inline uint64_t trace_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static TraceBuffer *thread_buffer() {
+  if (tls_buffer) {
+    return tls_buffer;
+  }
+  // once per thread, from trace_thread() or else on its first span
+  TraceBuffer *b = new TraceBuffer();
+  b->tid = syscall(SYS_gettid);
+  if (pthread_getname_np(pthread_self(), b->name, sizeof(b->name))) {
+    snprintf(b->name, sizeof(b->name), "%ld", b->tid);
+  }
+  b->phase_begin = trace_now();
+  TraceBuffer *head = buffers.load();
+  do {
+    b->older = head;
+  } while (!buffers.compare_exchange_weak(head, b));
+  tls_buffer = b;
+  return b;
+}
+
+static inline void record(const char *name, uint64_t begin, uint64_t end,
+                          bool phase) {
+  TraceBuffer *b = thread_buffer();
+  uint64_t n = b->next.load(std::memory_order_relaxed);
+  TraceEvent &e = b->events[n % TRACE_EVENTS_PER_THREAD];
+  e.name = name;
+  e.begin = begin;
+  e.end = end;
+  e.phase = phase;
+  b->next.store(n + 1, std::memory_order_release);
+}
+
+static void on_phase(LoopPhase from, LoopPhase to) {
+  if (!trace_on.load(std::memory_order_relaxed)) {
+    return;
+  }
+  TraceBuffer *b = thread_buffer();
+  uint64_t now = trace_now();
+  if (from != PHASE_IDLE) {
+    record(phase_name(from), b->phase_begin, now, true);
+  }
+  b->phase_begin = now;
+}
+
+TraceSpan::TraceSpan(const char *name) : name_(name), begin_(0) {
+  if (trace_on.load(std::memory_order_relaxed)) {
+    begin_ = trace_now();
+  }
+}
+
+TraceSpan::~TraceSpan() {
+  // a span that started before tracing was turned on is dropped
+  if (begin_ && trace_on.load(std::memory_order_relaxed)) {
+    record(name_, begin_, trace_now(), false);
+  }
+}
+
+const char *trace_wanted() {
+  const char *path = getenv("TOY_CAR_TRACE");
+  return path && *path ? path : nullptr;
+}
+
+void trace_start() {
+  static bool hooked = false;
+  if (!hooked && add_phase_hook(on_phase) == 0) {
+    hooked = true;
+  }
+  trace_origin = trace_now();
+  thread_buffer();
+  trace_on = true;
+}
+
+void trace_thread() {
+  if (trace_on.load(std::memory_order_relaxed)) {
+    thread_buffer();
+  }
+}
+
+int trace_stop(const char *path) {
+  trace_on = false;
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    return -1;
+  }
+  fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  const char *sep = "";
+  for (TraceBuffer *b = buffers.load(); b; b = b->older) {
+    // phases get a track of their own right next to the thread's spans
+    long phase_tid = b->tid + 1000000;
+    fprintf(f,
+            "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%ld,\"name\":\"thread_name\","
+            "\"args\":{\"name\":\"%s\"}},\n"
+            "{\"ph\":\"M\",\"pid\":1,\"tid\":%ld,\"name\":\"thread_name\","
+            "\"args\":{\"name\":\"%s phases\"}}",
+            sep, b->tid, b->name, phase_tid, b->name);
+    sep = ",\n";
+    uint64_t n = b->next.load(std::memory_order_acquire);
+    uint64_t first = n > TRACE_EVENTS_PER_THREAD ? n - TRACE_EVENTS_PER_THREAD
+                                                 : 0;
+    for (uint64_t i = first; i < n; i++) {
+      const TraceEvent &e = b->events[i % TRACE_EVENTS_PER_THREAD];
+      // Chrome wants microseconds
+      fprintf(f,
+              ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%ld,\"name\":\"%s\","
+              "\"ts\":%.3f,\"dur\":%.3f}",
+              e.phase ? phase_tid : b->tid, e.name,
+              static_cast<int64_t>(e.begin - trace_origin) / 1000.0,
+              (e.end - e.begin) / 1000.0);
+    }
+  }
+  fprintf(f, "\n]}\n");
+  return fclose(f) ? -1 : 0;
+}
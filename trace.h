@@ -0,0 +1,36 @@
+#pragma once
+#include <stdint.h>
+
+// Scoped spans written to a buffer owned by the writing thread, exported as
+// Chrome trace JSON (chrome://tracing, ui.perfetto.dev). Spans cost one
+// relaxed load while tracing is off.
+
+#define TRACE_EVENTS_PER_THREAD (1 << 17)
+
+// Set TOY_CAR_TRACE=<file> to trace, returns the file or nullptr.
+const char *trace_wanted();
+// Turns tracing on. Loop phases show up on a track of their own.
+void trace_start();
+// Gives the calling thread its buffer now if tracing is on, instead of on
+// its first span mid-run. Threads call it as they start, after
+// trace_start().
+void trace_thread();
+// Turns tracing off and writes what the buffers hold, the last
+// TRACE_EVENTS_PER_THREAD spans of each thread. Call once the other traced
+// threads are done. Returns -1 if the file can't be written.
+int trace_stop(const char *path);
+
+class TraceSpan {
+public:
+  explicit TraceSpan(const char *name);
+  ~TraceSpan();
+
+private:
+  const char *name_;
+  uint64_t begin_;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// name must be a string literal or otherwise outlive the trace
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name)
@@ -0,0 +1,208 @@
+// Sweeps the autopilot settings over simulated courses and prints the
+// parameter sets no other set beats on both completion time and collisions.
+#include "pool.h"
+#include "sim.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+struct Candidate {
+  AutopilotParams params;
+  // mean seconds to the goal, a course not finished counts the whole limit
+  double completion{0};
+  uint32_t collisions{0};
+  uint32_t finished{0};
+};
+
+static bool dominates(const Candidate &a, const Candidate &b) {
+  return a.completion <= b.completion && a.collisions <= b.collisions &&
+         (a.completion < b.completion || a.collisions < b.collisions);
+}
+
+static std::vector<Candidate> make_candidates() {
+  const double safe_distance[] = {0.3, 0.4, 0.5};
+  const uint32_t max_speed[] = {40, 60, 80, 100};
+  const uint32_t min_speed[] = {20, 30};
+  const uint32_t turn_speed[] = {50, 70, 90};
+  const double ttc_brake[] = {0.4, 0.6, 0.9};
+  const uint32_t growth[] = {1, 3, 5};
+
+  std::vector<Candidate> out;
+  for (double sd : safe_distance) {
+    for (uint32_t hi : max_speed) {
+      for (uint32_t lo : min_speed) {
+        for (uint32_t turn : turn_speed) {
+          for (double ttc : ttc_brake) {
+            Candidate c;
+            c.params.safe_distance = sd;
+            c.params.max_speed = hi;
+            c.params.min_speed = lo;
+            c.params.turn_speed = turn;
+            c.params.ttc_brake = ttc;
+            c.params.map_path = "";
+            c.params.sweep = true;
+            out.push_back(c);
+            // the growth pattern only matters to the zig-zag escape
+            c.params.sweep = false;
+            for (uint32_t g : growth) {
+              c.params.lookup_growth = g;
+              out.push_back(c);
+            }
+          }
+        }
+      }
+    }
+  }
+  return out;
+}
+
+// Every candidate on every course, one task per run, each writes only its
+// own slot. Returns the wall time in seconds.
+static double run_all(uint32_t *threads,
+                      const std::vector<Candidate> &candidates,
+                      const std::vector<SimCourse> &course, double seconds,
+                      std::vector<SimResult> *results) {
+  uint32_t courses = static_cast<uint32_t>(course.size());
+  results->assign(candidates.size() * courses, SimResult());
+  auto t0 = std::chrono::steady_clock::now();
+  {
+    WorkStealingPool pool(*threads);
+    *threads = pool.size();
+    for (size_t c = 0; c < candidates.size(); c++) {
+      for (uint32_t k = 0; k < courses; k++) {
+        SimResult *out = &(*results)[c * courses + k];
+        const AutopilotParams *params = &candidates[c].params;
+        const SimCourse *where = &course[k];
+        pool.submit([out, params, where, seconds] {
+          *out = sim_autopilot(*where, *params, seconds);
+        });
+      }
+    }
+    pool.wait();
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0)
+      .count();
+}
+
+int main(int argc, char **argv) {
+  uint32_t threads = std::thread::hardware_concurrency();
+  uint32_t courses = 8;
+  double seconds = 300;
+  bool scaling = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--scaling")) {
+      scaling = true;
+    } else if (!strcmp(argv[i], "--courses") && i + 1 < argc) {
+      courses = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else {
+      printf("usage: %s [--threads N] [--courses N] [--seconds S] "
+             "[--scaling]\n",
+             argv[0]);
+      return 1;
+    }
+  }
+  if (courses == 0 || seconds <= 0) {
+    printf("need at least one course and a positive time limit\n");
+    return 1;
+  }
+
+  // the control code logs every tick, far too much at simulation speed
+  std::cout.setstate(std::ios_base::badbit);
+  std::vector<Candidate> candidates = make_candidates();
+  // the escape turns are timed from turn_rate_dps, it must match the duty
+  std::map<uint32_t, double> turn_rate;
+  for (size_t i = 0; i < candidates.size(); i++) {
+    uint32_t t = candidates[i].params.turn_speed;
+    if (!turn_rate.count(t)) {
+      turn_rate[t] = sim_turn_rate(t);
+    }
+    candidates[i].params.turn_rate_dps = turn_rate[t];
+  }
+  std::vector<SimCourse> course(courses);
+  for (uint32_t i = 0; i < courses; i++) {
+    sim_build_course(i + 1, &course[i]);
+  }
+
+  std::vector<SimResult> results;
+  // the same sweep at 1, 2, 4 and --threads workers, the front comes from
+  // the last
+  std::vector<uint32_t> steps;
+  if (scaling) {
+    for (uint32_t n : {1u, 2u, 4u}) {
+      if (n < threads) {
+        steps.push_back(n);
+      }
+    }
+  }
+  steps.push_back(threads);
+  std::vector<double> rate(steps.size());
+  double wall = 0;
+  for (size_t i = 0; i < steps.size(); i++) {
+    wall = run_all(&steps[i], candidates, course, seconds, &results);
+    rate[i] = results.size() / wall;
+  }
+  threads = steps.back();
+  std::cout.clear();
+  if (scaling) {
+    printf("%u cores\n", std::thread::hardware_concurrency());
+    printf("%8s %8s %8s %10s\n", "threads", "runs/s", "speedup",
+           "efficiency");
+    for (size_t i = 0; i < steps.size(); i++) {
+      printf("%8u %8.1f %8.2f %9.0f%%\n", steps[i], rate[i],
+             rate[i] / rate[0], 100 * rate[i] / rate[0] / steps[i]);
+    }
+  }
+
+  for (size_t c = 0; c < candidates.size(); c++) {
+    double total = 0;
+    for (uint32_t k = 0; k < courses; k++) {
+      const SimResult &r = results[c * courses + k];
+      total += r.completion < 0 ? seconds : r.completion;
+      candidates[c].collisions += r.collisions;
+      candidates[c].finished += r.completion < 0 ? 0 : 1;
+    }
+    candidates[c].completion = total / courses;
+  }
+  std::vector<Candidate> front;
+  for (size_t i = 0; i < candidates.size(); i++) {
+    bool beaten = false;
+    for (size_t j = 0; j < candidates.size() && !beaten; j++) {
+      beaten = dominates(candidates[j], candidates[i]);
+    }
+    if (!beaten) {
+      front.push_back(candidates[i]);
+    }
+  }
+  std::sort(front.begin(), front.end(),
+            [](const Candidate &a, const Candidate &b) {
+              return a.completion < b.completion;
+            });
+
+  size_t runs = results.size();
+  printf("%zu parameter sets x %u courses, %.0fs limit\n", candidates.size(),
+         courses, seconds);
+  printf("%zu runs on %u threads in %.2fs, %.1f runs/s, %.1f runs/s per "
+         "thread\n",
+         runs, threads, wall, runs / wall, runs / wall / threads);
+  printf("pareto front:\n");
+  printf("%8s %6s %6s %6s %6s %6s %5s %7s %8s %10s\n", "escape", "safe",
+         "min", "max", "turn", "ttc", "grow", "done", "time(s)", "collisions");
+  for (size_t i = 0; i < front.size(); i++) {
+    const AutopilotParams &p = front[i].params;
+    printf("%8s %6.2f %6u %6u %6u %6.2f %5s %3u/%-3u %8.1f %10u\n",
+           p.sweep ? "sweep" : "zigzag", p.safe_distance, p.min_speed,
+           p.max_speed, p.turn_speed, p.ttc_brake,
+           p.sweep ? "-" : std::to_string(p.lookup_growth).c_str(),
+           front[i].finished, courses, front[i].completion,
+           front[i].collisions);
+  }
+  return 0;
+}